@@ -0,0 +1,1122 @@
+/**
+ * Copyright (C) 2018 socware.net.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://socware.net
+ */
+
+/*
+ * Microbenchmarks for the libposix primitives, with the raw hyperC calls
+ * they wrap as a baseline. Results are printed as CSV, one line per case:
+ *
+ *   name,param,ops,ns_per_op,ops_per_sec
+ *
+ * usage: posix_bench [iterations] [name prefix]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <mqueue.h>
+#include <hcos_msg.h>
+#include <hcos_topic.h>
+#include <hcos_pipe.h>
+#include <hcos_pool.h>
+#include <time.h>
+
+#define BENCH_MQ_NAME  "/bench"
+
+#define ARRAY_SZ(_a) (sizeof(_a) / sizeof((_a)[0]))
+
+static unsigned long iters = 100000;
+
+static const char *filter;
+
+static void *bench_alloc(posix_obj_t type, unsigned sz)
+{
+	return malloc(sz);
+}
+
+static void bench_free(posix_obj_t type, void *p)
+{
+	free(p);
+}
+
+/**
+ * @brief Nanoseconds from the host monotonic clock.
+ *
+ * clock_gettime() is provided by libposix and only has tick resolution, the
+ * system call is used instead.
+ */
+static long long now_ns(void)
+{
+	struct timespec ts;
+	syscall(SYS_clock_gettime, CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NANOSECONDS_PER_SECOND + ts.tv_nsec;
+}
+
+static int selected(const char *name)
+{
+	return !filter || strncmp(name, filter, strlen(filter)) == 0;
+}
+
+static void report(const char *name, const char *param,
+		   unsigned long ops, long long ns)
+{
+	double per_op = ops ? (double)ns / ops : 0;
+	double per_sec = ns ? ops * 1e9 / ns : 0;
+	printf("%s,%s,%lu,%.1f,%.0f\n", name, param, ops, per_op, per_sec);
+}
+
+static pthread_t spawn(void *(*fun) (void *), void *arg)
+{
+	pthread_t t;
+	if (pthread_create(&t, 0, fun, arg) != 0) {
+		fprintf(stderr, "pthread_create failed\n");
+		exit(1);
+	}
+	return t;
+}
+
+static void bench_mut_raw(void)
+{
+	mut_t m;
+	unsigned long i;
+	long long t0;
+
+	mut_init(&m);
+	t0 = now_ns();
+	for (i = 0; i < iters; i++) {
+		mut_lock(&m, WAIT);
+		mut_unlock(&m);
+	}
+	report("mut_lock_unlock_raw", "", iters, now_ns() - t0);
+}
+
+static void bench_mutex(void)
+{
+	pthread_mutex_t m;
+	unsigned long i;
+	long long t0;
+
+	pthread_mutex_init(&m, 0);
+	t0 = now_ns();
+	for (i = 0; i < iters; i++) {
+		pthread_mutex_lock(&m);
+		pthread_mutex_unlock(&m);
+	}
+	report("pthread_mutex_lock_unlock", "", iters, now_ns() - t0);
+	pthread_mutex_destroy(&m);
+}
+
+typedef struct contend {
+	pthread_mutex_t m;
+	pthread_barrier_t start;
+	unsigned long n;
+	volatile unsigned long count;
+} contend_t;
+
+typedef struct contender {
+	contend_t *c;
+	long long t0, t1;	///< Time span of this thread's loop.
+} contender_t;
+
+static void *contend_thread(void *p)
+{
+	contender_t *me = (contender_t *) p;
+	contend_t *c = me->c;
+	unsigned long i;
+
+	pthread_barrier_wait(&c->start);
+	me->t0 = now_ns();
+	for (i = 0; i < c->n; i++) {
+		pthread_mutex_lock(&c->m);
+		c->count++;
+		pthread_mutex_unlock(&c->m);
+	}
+	me->t1 = now_ns();
+	return 0;
+}
+
+static void bench_mutex_contended(void)
+{
+	static const int nthreads[] = { 2, 4, 8 };
+	unsigned k;
+
+	for (k = 0; k < ARRAY_SZ(nthreads); k++) {
+		contender_t who[8];
+		pthread_t t[8];
+		contend_t c;
+		char param[32];
+		long long t0, t1;
+		int i;
+
+		pthread_mutex_init(&c.m, 0);
+		pthread_barrier_init(&c.start, 0, nthreads[k]);
+		c.n = iters / nthreads[k];
+		c.count = 0;
+		for (i = 0; i < nthreads[k]; i++) {
+			who[i].c = &c;
+			t[i] = spawn(contend_thread, &who[i]);
+		}
+		for (i = 0; i < nthreads[k]; i++)
+			pthread_join(t[i], 0);
+		// Wall time from the first thread starting to the last finishing.
+		t0 = who[0].t0;
+		t1 = who[0].t1;
+		for (i = 1; i < nthreads[k]; i++) {
+			if (who[i].t0 < t0)
+				t0 = who[i].t0;
+			if (who[i].t1 > t1)
+				t1 = who[i].t1;
+		}
+		snprintf(param, sizeof(param), "threads=%d", nthreads[k]);
+		report("pthread_mutex_contended", param, c.count, t1 - t0);
+		pthread_barrier_destroy(&c.start);
+		pthread_mutex_destroy(&c.m);
+	}
+}
+
+typedef struct pingpong {
+	pthread_mutex_t m;
+	pthread_cond_t c[2];
+	sem_t s[2];
+	int turn;
+} pingpong_t;
+
+static void *cond_pong(void *p)
+{
+	pingpong_t *pp = (pingpong_t *) p;
+	unsigned long i;
+
+	pthread_mutex_lock(&pp->m);
+	for (i = 0; i < iters; i++) {
+		while (pp->turn != 1)
+			pthread_cond_wait(&pp->c[1], &pp->m);
+		pp->turn = 0;
+		pthread_cond_signal(&pp->c[0]);
+	}
+	pthread_mutex_unlock(&pp->m);
+	return 0;
+}
+
+static void bench_cond_pingpong(void)
+{
+	pingpong_t pp;
+	pthread_t t;
+	unsigned long i;
+	long long t0;
+
+	pthread_mutex_init(&pp.m, 0);
+	pthread_cond_init(&pp.c[0], 0);
+	pthread_cond_init(&pp.c[1], 0);
+	pp.turn = 0;
+	t = spawn(cond_pong, &pp);
+	t0 = now_ns();
+	pthread_mutex_lock(&pp.m);
+	for (i = 0; i < iters; i++) {
+		pp.turn = 1;
+		pthread_cond_signal(&pp.c[1]);
+		while (pp.turn != 0)
+			pthread_cond_wait(&pp.c[0], &pp.m);
+	}
+	pthread_mutex_unlock(&pp.m);
+	pthread_join(t, 0);
+	report("pthread_cond_pingpong", "round_trip", iters, now_ns() - t0);
+}
+
+static void bench_sem_raw(void)
+{
+	sem_t s;
+	unsigned long i;
+	long long t0;
+
+	sem_init(&s, 0);
+	t0 = now_ns();
+	for (i = 0; i < iters; i++) {
+		sem_post(&s);
+		sem_get(&s, WAIT);
+	}
+	report("sem_post_get_raw", "", iters, now_ns() - t0);
+}
+
+static void bench_sem(void)
+{
+	sem_t s;
+	unsigned long i;
+	long long t0;
+
+	sem_init_posix(&s, 0, 0);
+	t0 = now_ns();
+	for (i = 0; i < iters; i++) {
+		sem_post(&s);
+		sem_wait(&s);
+	}
+	report("sem_post_wait", "", iters, now_ns() - t0);
+	sem_destroy(&s);
+}
+
+static void *sem_pong(void *p)
+{
+	pingpong_t *pp = (pingpong_t *) p;
+	unsigned long i;
+
+	for (i = 0; i < iters; i++) {
+		sem_wait(&pp->s[1]);
+		sem_post(&pp->s[0]);
+	}
+	return 0;
+}
+
+static void bench_sem_pingpong(void)
+{
+	pingpong_t pp;
+	pthread_t t;
+	unsigned long i;
+	long long t0;
+
+	sem_init_posix(&pp.s[0], 0, 0);
+	sem_init_posix(&pp.s[1], 0, 0);
+	t = spawn(sem_pong, &pp);
+	t0 = now_ns();
+	for (i = 0; i < iters; i++) {
+		sem_post(&pp.s[1]);
+		sem_wait(&pp.s[0]);
+	}
+	pthread_join(t, 0);
+	report("sem_pingpong", "round_trip", iters, now_ns() - t0);
+}
+
+static const int mq_sizes[] = { 4, 16, 64, 256 };
+
+static const int mq_depths[] = { 1, 16, 128 };
+
+static void bench_mq_raw(void)
+{
+	unsigned k;
+
+	for (k = 0; k < ARRAY_SZ(mq_sizes); k++) {
+		int nwords = (mq_sizes[k] + 3) >> 2;
+		int depth = 16;
+		unsigned *buf = malloc(depth * nwords * sizeof(unsigned));
+		unsigned msg[64];
+		unsigned long i;
+		char param[32];
+		long long t0;
+		int j;
+		mq_t q;
+
+		mq_init(&q, nwords, buf, depth * nwords * sizeof(unsigned));
+		memset(msg, 0, sizeof(msg));
+		t0 = now_ns();
+		for (i = 0; i < iters; i += depth) {
+			for (j = 0; j < depth; j++)
+				mq_put(&q, msg, WAIT);
+			for (j = 0; j < depth; j++)
+				mq_get(&q, msg, WAIT);
+		}
+		snprintf(param, sizeof(param), "size=%d", mq_sizes[k]);
+		report("mq_put_get_raw", param, i, now_ns() - t0);
+		free(buf);
+	}
+}
+
+static mqd_t bench_mq_open_flags(int size, int depth, int oflag)
+{
+	struct mq_attr attr = {
+		.mq_flags = 0,
+		.mq_maxmsg = depth,
+		.mq_msgsize = size,
+		.mq_curmsgs = 0,
+	};
+	mqd_t q = mq_open(BENCH_MQ_NAME, O_CREAT | O_EXCL | O_RDWR | oflag, 0,
+			  &attr);
+	if (q == (mqd_t) - 1) {
+		perror("mq_open");
+		exit(1);
+	}
+	return q;
+}
+
+static mqd_t bench_mq_open(int size, int depth)
+{
+	return bench_mq_open_flags(size, depth, 0);
+}
+
+static void bench_mq_close(mqd_t q)
+{
+	mq_close(q);
+	mq_unlink(BENCH_MQ_NAME);
+}
+
+static void bench_mq(void)
+{
+	unsigned k;
+
+	for (k = 0; k < ARRAY_SZ(mq_sizes); k++) {
+		int depth = 16;
+		mqd_t q = bench_mq_open(mq_sizes[k], depth);
+		unsigned msg[64];
+		unsigned long i;
+		char param[32];
+		long long t0;
+		int j;
+
+		memset(msg, 0, sizeof(msg));
+		t0 = now_ns();
+		for (i = 0; i < iters; i += depth) {
+			for (j = 0; j < depth; j++)
+				mq_send(q, (char *)msg, mq_sizes[k], 0);
+			for (j = 0; j < depth; j++)
+				mq_receive(q, (char *)msg, sizeof(msg), 0);
+		}
+		snprintf(param, sizeof(param), "size=%d", mq_sizes[k]);
+		report("mq_send_receive", param, i, now_ns() - t0);
+		bench_mq_close(q);
+	}
+}
+
+/**
+ * Same loop as mq_send_receive with an odd size at odd offsets, passed
+ * straight to the queue, then bounced through an aligned buffer as
+ * callers had to while unaligned pointers were refused.
+ */
+static void bench_mq_unaligned(void)
+{
+	enum { SIZE = 61 };
+	int bounce;
+
+	for (bounce = 0; bounce < 2; bounce++) {
+		int depth = 16;
+		mqd_t q = bench_mq_open(SIZE, depth);
+		unsigned msg[64], tmp[64];
+		char *p = (char *)msg + 1;
+		unsigned long i;
+		char param[32];
+		long long t0;
+		int j;
+
+		memset(msg, 0, sizeof(msg));
+		t0 = now_ns();
+		for (i = 0; i < iters; i += depth) {
+			for (j = 0; j < depth; j++) {
+				if (bounce) {
+					memcpy(tmp, p, SIZE);
+					mq_send(q, (char *)tmp, SIZE, 0);
+				} else {
+					mq_send(q, p, SIZE, 0);
+				}
+			}
+			for (j = 0; j < depth; j++) {
+				if (bounce) {
+					mq_receive(q, (char *)tmp, SIZE, 0);
+					memcpy(p, tmp, SIZE);
+				} else {
+					mq_receive(q, p, SIZE, 0);
+				}
+			}
+		}
+		snprintf(param, sizeof(param), "size=%d;copy=%s", SIZE,
+			 bounce ? "bounce" : "direct");
+		report("mq_send_receive_unaligned", param, i, now_ns() - t0);
+		bench_mq_close(q);
+	}
+}
+
+/**
+ * Same loop as mq_send_receive at size 16, but each burst spreads its
+ * messages over prios priorities, so receive has to pick across runs.
+ */
+static void bench_mq_prio(void)
+{
+	static const int prios[] = { 1, 4, 32 };
+	unsigned k;
+
+	for (k = 0; k < ARRAY_SZ(prios); k++) {
+		int depth = 16;
+		mqd_t q = bench_mq_open(16, depth);
+		unsigned msg[64];
+		unsigned long i;
+		char param[32];
+		long long t0;
+		int j;
+
+		memset(msg, 0, sizeof(msg));
+		t0 = now_ns();
+		for (i = 0; i < iters; i += depth) {
+			for (j = 0; j < depth; j++)
+				mq_send(q, (char *)msg, 16,
+					(j * 7) % prios[k]);
+			for (j = 0; j < depth; j++)
+				mq_receive(q, (char *)msg, sizeof(msg), 0);
+		}
+		snprintf(param, sizeof(param), "prios=%d", prios[k]);
+		report("mq_send_receive_prio", param, i, now_ns() - t0);
+		bench_mq_close(q);
+	}
+}
+
+/**
+ * Event traffic: 8 byte messages with a 512 byte frame every 16th, through
+ * a 512 byte slot queue and a MQ_VARLEN queue.
+ */
+static void bench_mq_varlen(void)
+{
+	static const char *const modes[] = { "fixed", "varlen" };
+	unsigned k;
+
+	for (k = 0; k < ARRAY_SZ(modes); k++) {
+		int depth = 16;
+		mqd_t q = bench_mq_open_flags(512, depth, k ? MQ_VARLEN : 0);
+		unsigned msg[128];
+		unsigned long i;
+		char param[32];
+		long long t0;
+		int j;
+
+		memset(msg, 0, sizeof(msg));
+		t0 = now_ns();
+		for (i = 0; i < iters; i += depth) {
+			for (j = 0; j < depth; j++)
+				mq_send(q, (char *)msg, j ? 8 : 512, 0);
+			for (j = 0; j < depth; j++)
+				mq_receive(q, (char *)msg, sizeof(msg), 0);
+		}
+		snprintf(param, sizeof(param), "mode=%s", modes[k]);
+		report("mq_send_receive_mixed", param, i, now_ns() - t0);
+		bench_mq_close(q);
+	}
+}
+
+/**
+ * mq_send_receive through the loan API: build and parse in place.
+ */
+static void bench_mq_loan(void)
+{
+	unsigned k;
+
+	for (k = 0; k < ARRAY_SZ(mq_sizes); k++) {
+		int depth = 16;
+		mqd_t q = bench_mq_open(mq_sizes[k], depth);
+		void *msg[16];
+		unsigned long i;
+		char param[32];
+		long long t0;
+		size_t len;
+		int j;
+
+		t0 = now_ns();
+		for (i = 0; i < iters; i += depth) {
+			for (j = 0; j < depth; j++) {
+				msg[j] = mq_reserve(q, mq_sizes[k], 0);
+				*(unsigned *)msg[j] = j;
+				mq_commit(q, msg[j], mq_sizes[k], 0);
+			}
+			for (j = 0; j < depth; j++) {
+				msg[j] = mq_peek(q, &len, 0, 0);
+				mq_release(q, msg[j]);
+			}
+		}
+		snprintf(param, sizeof(param), "size=%d", mq_sizes[k]);
+		report("mq_reserve_peek", param, i, now_ns() - t0);
+		bench_mq_close(q);
+	}
+}
+
+/**
+ * mq_send_receive moving each burst of depth messages with one batch call
+ * per direction.
+ */
+static void bench_mq_batch(void)
+{
+	unsigned k;
+
+	for (k = 0; k < ARRAY_SZ(mq_sizes); k++) {
+		int depth = 16;
+		mqd_t q = bench_mq_open(mq_sizes[k], depth);
+		unsigned msg[16][64];
+		struct mq_msgvec vec[16];
+		unsigned long i;
+		char param[32];
+		long long t0;
+		int j;
+
+		memset(msg, 0, sizeof(msg));
+		t0 = now_ns();
+		for (i = 0; i < iters; i += depth) {
+			for (j = 0; j < depth; j++) {
+				vec[j].msg_ptr = (char *)msg[j];
+				vec[j].msg_len = mq_sizes[k];
+				vec[j].msg_prio = 0;
+			}
+			mq_send_batch(q, vec, depth, 0);
+			for (j = 0; j < depth; j++)
+				vec[j].msg_len = sizeof(msg[j]);
+			mq_receive_batch(q, vec, depth, 0);
+		}
+		snprintf(param, sizeof(param), "size=%d;batch=%d", mq_sizes[k],
+			 depth);
+		report("mq_send_receive_batch", param, i, now_ns() - t0);
+		bench_mq_close(q);
+	}
+}
+
+typedef struct mq_peer {
+	mqd_t q;
+	int size;
+} mq_peer_t;
+
+static void *mq_consumer(void *p)
+{
+	mq_peer_t *peer = (mq_peer_t *) p;
+	unsigned msg[64];
+	unsigned long i;
+
+	for (i = 0; i < iters; i++) {
+		if (mq_receive(peer->q, (char *)msg, sizeof(msg), 0) < 0) {
+			perror("mq_receive");
+			exit(1);
+		}
+	}
+	return 0;
+}
+
+static void bench_mq_threads(void)
+{
+	unsigned k, d;
+
+	for (k = 0; k < ARRAY_SZ(mq_sizes); k++) {
+		for (d = 0; d < ARRAY_SZ(mq_depths); d++) {
+			mq_peer_t peer;
+			unsigned msg[64];
+			unsigned long i;
+			char param[32];
+			long long t0;
+			pthread_t t;
+
+			peer.size = mq_sizes[k];
+			peer.q = bench_mq_open(peer.size, mq_depths[d]);
+			memset(msg, 0, sizeof(msg));
+			t = spawn(mq_consumer, &peer);
+			t0 = now_ns();
+			for (i = 0; i < iters; i++) {
+				if (mq_send(peer.q, (char *)msg, peer.size, 0)) {
+					perror("mq_send");
+					exit(1);
+				}
+			}
+			pthread_join(t, 0);
+			snprintf(param, sizeof(param), "size=%d;depth=%d",
+				 mq_sizes[k], mq_depths[d]);
+			report("mq_producer_consumer", param, iters,
+			       now_ns() - t0);
+			bench_mq_close(peer.q);
+		}
+	}
+}
+
+/**
+ * MQ_SPSC ring: the single-thread burst of mq_send_receive, then the
+ * producer/consumer pair of mq_producer_consumer, both at size 16.
+ */
+static void bench_mq_spsc(void)
+{
+	unsigned d;
+	unsigned msg[64];
+	unsigned long i;
+	char param[32];
+	long long t0;
+	int j;
+
+	{
+		int depth = 16;
+		mqd_t q = bench_mq_open_flags(16, depth, MQ_SPSC);
+
+		memset(msg, 0, sizeof(msg));
+		t0 = now_ns();
+		for (i = 0; i < iters; i += depth) {
+			for (j = 0; j < depth; j++)
+				mq_send(q, (char *)msg, 16, 0);
+			for (j = 0; j < depth; j++)
+				mq_receive(q, (char *)msg, sizeof(msg), 0);
+		}
+		report("mq_spsc_send_receive", "size=16", i, now_ns() - t0);
+		bench_mq_close(q);
+	}
+	for (d = 0; d < ARRAY_SZ(mq_depths); d++) {
+		mq_peer_t peer;
+		pthread_t t;
+
+		peer.size = 16;
+		peer.q = bench_mq_open_flags(peer.size, mq_depths[d], MQ_SPSC);
+		t = spawn(mq_consumer, &peer);
+		t0 = now_ns();
+		for (i = 0; i < iters; i++) {
+			if (mq_send(peer.q, (char *)msg, peer.size, 0)) {
+				perror("mq_send");
+				exit(1);
+			}
+		}
+		pthread_join(t, 0);
+		snprintf(param, sizeof(param), "size=16;depth=%d",
+			 mq_depths[d]);
+		report("mq_spsc_producer_consumer", param, iters,
+		       now_ns() - t0);
+		bench_mq_close(peer.q);
+	}
+}
+
+typedef struct rpc_peer {
+	msg_chan_t ch;
+	mqd_t req;
+	mqd_t rep;
+} rpc_peer_t;
+
+static void *msg_server(void *p)
+{
+	rpc_peer_t *peer = (rpc_peer_t *) p;
+	unsigned msg[4];
+	msg_rcvid_t id;
+	unsigned long i;
+
+	for (i = 0; i < iters; i++) {
+		if (msg_receive(&peer->ch, msg, sizeof(msg), &id, 0) < 0) {
+			perror("msg_receive");
+			exit(1);
+		}
+		msg_reply(id, msg, sizeof(msg));
+	}
+	return 0;
+}
+
+static void *mq_server(void *p)
+{
+	rpc_peer_t *peer = (rpc_peer_t *) p;
+	unsigned msg[4];
+	unsigned long i;
+
+	for (i = 0; i < iters; i++) {
+		if (mq_receive(peer->req, (char *)msg, sizeof(msg), 0) < 0) {
+			perror("mq_receive");
+			exit(1);
+		}
+		mq_send(peer->rep, (char *)msg, sizeof(msg), 0);
+	}
+	return 0;
+}
+
+/**
+ * 16 byte request/response round trips: msg_send against a server in
+ * msg_receive/msg_reply, and the same over a request and a reply queue.
+ */
+static void bench_msg_rpc(void)
+{
+	rpc_peer_t peer;
+	unsigned msg[4];
+	unsigned long i;
+	long long t0;
+	pthread_t t;
+
+	memset(msg, 0, sizeof(msg));
+	msg_chan_init(&peer.ch);
+	t = spawn(msg_server, &peer);
+	t0 = now_ns();
+	for (i = 0; i < iters; i++) {
+		if (msg_send(&peer.ch, msg, sizeof(msg), msg, sizeof(msg), 0)
+		    < 0) {
+			perror("msg_send");
+			exit(1);
+		}
+	}
+	pthread_join(t, 0);
+	report("msg_send_reply", "size=16", iters, now_ns() - t0);
+	msg_chan_destroy(&peer.ch);
+
+	// The queues stay usable after the name is unlinked.
+	peer.req = bench_mq_open(sizeof(msg), 1);
+	mq_unlink(BENCH_MQ_NAME);
+	peer.rep = bench_mq_open(sizeof(msg), 1);
+	t = spawn(mq_server, &peer);
+	t0 = now_ns();
+	for (i = 0; i < iters; i++) {
+		mq_send(peer.req, (char *)msg, sizeof(msg), 0);
+		if (mq_receive(peer.rep, (char *)msg, sizeof(msg), 0) < 0) {
+			perror("mq_receive");
+			exit(1);
+		}
+	}
+	pthread_join(t, 0);
+	report("mq_send_reply", "size=16", iters, now_ns() - t0);
+	mq_close(peer.req);
+	bench_mq_close(peer.rep);
+}
+
+/**
+ * One producer feeding four readers 256 byte frames: a topic publish that
+ * shares one buffer, and the same frame sent into four queues.
+ */
+static void bench_topic(void)
+{
+	enum { NSUBS = 4, SIZE = 256 };
+	topic_t topic;
+	topic_sub_t sub[NSUBS];
+	mqd_t q[NSUBS];
+	unsigned msg[SIZE / 4];
+	const void *m;
+	size_t len;
+	unsigned long i;
+	long long t0;
+	int j;
+
+	memset(msg, 0, sizeof(msg));
+	topic_init(&topic, NSUBS, SIZE);
+	for (j = 0; j < NSUBS; j++)
+		topic_subscribe(&topic, &sub[j], 1);
+	t0 = now_ns();
+	for (i = 0; i < iters; i++) {
+		topic_publish(&topic, msg, SIZE, 0);
+		for (j = 0; j < NSUBS; j++) {
+			m = topic_receive(&sub[j], &len, 0);
+			topic_release(&sub[j], m);
+		}
+	}
+	report("topic_fanout", "size=256;subs=4", iters, now_ns() - t0);
+	for (j = 0; j < NSUBS; j++)
+		topic_unsubscribe(&sub[j]);
+	topic_destroy(&topic);
+
+	for (j = 0; j < NSUBS; j++) {
+		q[j] = bench_mq_open(SIZE, 1);
+		mq_unlink(BENCH_MQ_NAME);
+	}
+	t0 = now_ns();
+	for (i = 0; i < iters; i++) {
+		for (j = 0; j < NSUBS; j++)
+			mq_send(q[j], (char *)msg, SIZE, 0);
+		for (j = 0; j < NSUBS; j++)
+			mq_receive(q[j], (char *)msg, SIZE, 0);
+	}
+	report("mq_fanout", "size=256;subs=4", iters, now_ns() - t0);
+	for (j = 0; j < NSUBS; j++)
+		mq_close(q[j]);
+}
+
+static void *pipe_reader(void *p)
+{
+	pipe_t *pipe = (pipe_t *) p;
+	unsigned long total = iters * 16;
+	char buf[256];
+	ssize_t n;
+
+	while (total) {
+		n = pipe_read(pipe, buf, sizeof(buf), 0);
+		if (n <= 0) {
+			perror("pipe_read");
+			exit(1);
+		}
+		total -= n;
+	}
+	return 0;
+}
+
+/**
+ * A 16 byte record stream through a byte pipe, with and without a read
+ * threshold, to compare against mq_producer_consumer at size 16.
+ */
+static void bench_pipe(void)
+{
+	static const unsigned lows[] = { 1, 256 };
+	char msg[16];
+	unsigned long i;
+	char param[32];
+	long long t0;
+	pipe_t pipe;
+	pthread_t t;
+	unsigned k;
+
+	memset(msg, 0, sizeof(msg));
+	for (k = 0; k < ARRAY_SZ(lows); k++) {
+		pipe_init(&pipe, 2048);
+		pipe_setthreshold(&pipe, lows[k], 1);
+		t = spawn(pipe_reader, &pipe);
+		t0 = now_ns();
+		for (i = 0; i < iters; i++) {
+			if (pipe_write(&pipe, msg, sizeof(msg), 0) !=
+			    sizeof(msg)) {
+				perror("pipe_write");
+				exit(1);
+			}
+		}
+		pthread_join(t, 0);
+		snprintf(param, sizeof(param), "size=16;rd_low=%u", lows[k]);
+		report("pipe_producer_consumer", param, iters, now_ns() - t0);
+		pipe_destroy(&pipe);
+	}
+}
+
+static void bench_mq_open_close(void)
+{
+	enum { NQUEUES = 100 };
+	struct mq_attr attr = {
+		.mq_flags = 0,
+		.mq_maxmsg = 1,
+		.mq_msgsize = 4,
+		.mq_curmsgs = 0,
+	};
+	static mqd_t q[NQUEUES];
+	char name[POSIX_NAME_MAX];
+	unsigned long i;
+	long long t0;
+	int j;
+
+	for (j = 0; j < NQUEUES; j++) {
+		snprintf(name, sizeof(name), "/bench/queue/%d", j);
+		q[j] = mq_open(name, O_CREAT | O_RDWR, 0, &attr);
+	}
+	t0 = now_ns();
+	for (i = 0; i < iters; i++) {
+		snprintf(name, sizeof(name), "/bench/queue/%lu",
+			 i % NQUEUES);
+		mq_close(mq_open(name, O_RDWR, 0, 0));
+	}
+	snprintf(name, sizeof(name), "queues=%d", NQUEUES);
+	report("mq_open_close", name, iters, now_ns() - t0);
+	for (j = 0; j < NQUEUES; j++) {
+		snprintf(name, sizeof(name), "/bench/queue/%d", j);
+		mq_close(q[j]);
+		mq_unlink(name);
+	}
+}
+
+static void *empty_thread(void *p)
+{
+	return p;
+}
+
+static void bench_create_join(void)
+{
+	unsigned long i, n = iters / 10;
+	long long t0 = now_ns();
+
+	for (i = 0; i < n; i++) {
+		pthread_t t = spawn(empty_thread, 0);
+		pthread_join(t, 0);
+	}
+	report("pthread_create_join", "", n, now_ns() - t0);
+}
+
+static void empty_job(void *p)
+{
+}
+
+/**
+ * One job at a time through a worker pool, the pool counterpart of
+ * pthread_create_join, then bursts of depth jobs over four workers.
+ */
+static void bench_pool(void)
+{
+	enum { DEPTH = 64 };
+	int pri = sched_get_priority_max(SCHED_OTHER) - 1;
+	posix_pool_t pool;
+	unsigned long i, n = iters / 10;
+	long long t0;
+	int j;
+
+	posix_pool_init(&pool, 1, 1, 0, pri);
+	t0 = now_ns();
+	for (i = 0; i < n; i++) {
+		posix_pool_submit(&pool, empty_job, 0, 0);
+		posix_pool_wait(&pool, 0);
+	}
+	report("pool_submit_wait", "workers=1", n, now_ns() - t0);
+	posix_pool_destroy(&pool, 1);
+
+	posix_pool_init(&pool, 4, DEPTH, 0, pri);
+	t0 = now_ns();
+	for (i = 0; i < iters; i += DEPTH) {
+		for (j = 0; j < DEPTH; j++)
+			posix_pool_submit(&pool, empty_job, 0, 0);
+		posix_pool_wait(&pool, 0);
+	}
+	report("pool_submit_burst", "workers=4;depth=64", i, now_ns() - t0);
+	posix_pool_destroy(&pool, 1);
+}
+
+enum { FRAME = 4096, FRAME_THREADS = 4 };
+
+static float frame[FRAME];
+
+/**
+ * Uneven per-element cost: the upper quarter of the frame is eight times
+ * as expensive, so equal static slices finish at different times.
+ */
+static void frame_work(long lo, long hi, void *p)
+{
+	long i;
+	int k, reps;
+
+	for (i = lo; i < hi; i++) {
+		reps = (i >= FRAME * 3 / 4) ? 8 : 1;
+		for (k = 0; k < reps; k++)
+			frame[i] = frame[i] * 0.5f + 1.0f;
+	}
+}
+
+typedef struct frame_slice {
+	long lo;
+	long hi;
+} frame_slice_t;
+
+static void *frame_thread(void *p)
+{
+	frame_slice_t *s = (frame_slice_t *) p;
+
+	frame_work(s->lo, s->hi, 0);
+	return 0;
+}
+
+/**
+ * A frame split over FRAME_THREADS threads: created and joined for every
+ * frame, then run by posix_pool_parallel_for on a pool of FRAME_THREADS - 1
+ * workers plus the caller.
+ */
+static void bench_parallel_for(void)
+{
+	int pri = sched_get_priority_max(SCHED_OTHER) - 1;
+	frame_slice_t slice[FRAME_THREADS];
+	pthread_t t[FRAME_THREADS];
+	unsigned long i, n = iters / 10;
+	posix_pool_t pool;
+	long long t0;
+	int j;
+
+	t0 = now_ns();
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < FRAME_THREADS; j++) {
+			slice[j].lo = (long)FRAME * j / FRAME_THREADS;
+			slice[j].hi = (long)FRAME * (j + 1) / FRAME_THREADS;
+			t[j] = spawn(frame_thread, &slice[j]);
+		}
+		for (j = 0; j < FRAME_THREADS; j++)
+			pthread_join(t[j], 0);
+	}
+	report("parallel_for", "mode=create_join;n=4096;threads=4", n,
+	       now_ns() - t0);
+
+	posix_pool_init(&pool, FRAME_THREADS - 1, FRAME_THREADS, 0, pri);
+	t0 = now_ns();
+	for (i = 0; i < n; i++)
+		posix_pool_parallel_for(&pool, 0, FRAME, 64, frame_work, 0);
+	report("parallel_for", "mode=pool;n=4096;threads=4;grain=64", n,
+	       now_ns() - t0);
+	posix_pool_destroy(&pool, 1);
+
+	t0 = now_ns();
+	for (i = 0; i < n; i++)
+		frame_work(0, FRAME, 0);
+	report("parallel_for", "mode=serial;n=4096", n, now_ns() - t0);
+}
+
+static void timer_fire(union sigval v)
+{
+}
+
+static void bench_timer(void)
+{
+	struct sigevent ev = {
+		.sigev_notify = SIGEV_THREAD,
+		.sigev_notify_function = timer_fire,
+	};
+	struct itimerspec its = {
+		.it_interval = {0, 0},
+		.it_value = {1, 0},
+	};
+	unsigned long i;
+	long long t0;
+	timer_t tm;
+
+	if (timer_create(CLOCK_REALTIME, &ev, &tm) != 0) {
+		perror("timer_create");
+		exit(1);
+	}
+	t0 = now_ns();
+	for (i = 0; i < iters; i++)
+		timer_settime(tm, 0, &its, 0);
+	report("timer_settime", "relative", iters, now_ns() - t0);
+	timer_delete(tm);
+}
+
+static const struct {
+	const char *name;
+	void (*run) (void);
+} benches[] = {
+	{"mut_lock_unlock_raw", bench_mut_raw},
+	{"pthread_mutex_lock_unlock", bench_mutex},
+	{"pthread_mutex_contended", bench_mutex_contended},
+	{"pthread_cond_pingpong", bench_cond_pingpong},
+	{"sem_post_get_raw", bench_sem_raw},
+	{"sem_post_wait", bench_sem},
+	{"sem_pingpong", bench_sem_pingpong},
+	{"mq_put_get_raw", bench_mq_raw},
+	{"mq_send_receive", bench_mq},
+	{"mq_send_receive_prio", bench_mq_prio},
+	{"mq_send_receive_unaligned", bench_mq_unaligned},
+	{"mq_send_receive_mixed", bench_mq_varlen},
+	{"mq_reserve_peek", bench_mq_loan},
+	{"mq_send_receive_batch", bench_mq_batch},
+	{"mq_producer_consumer", bench_mq_threads},
+	{"mq_spsc", bench_mq_spsc},
+	{"msg_rpc", bench_msg_rpc},
+	{"topic", bench_topic},
+	{"pipe", bench_pipe},
+	{"mq_open_close", bench_mq_open_close},
+	{"pthread_create_join", bench_create_join},
+	{"pool", bench_pool},
+	{"parallel_for", bench_parallel_for},
+	{"timer_settime", bench_timer},
+};
+
+int main(int argc, char **argv)
+{
+	unsigned k;
+
+	if (argc > 1)
+		iters = strtoul(argv[1], 0, 0);
+	if (argc > 2)
+		filter = argv[2];
+	if (iters == 0) {
+		fprintf(stderr, "usage: %s [iterations] [name prefix]\n",
+			argv[0]);
+		return 1;
+	}
+	hcos_posix_init(bench_alloc, bench_free);
+	setvbuf(stdout, 0, _IOLBF, 0);
+
+	printf("name,param,ops,ns_per_op,ops_per_sec\n");
+	for (k = 0; k < ARRAY_SZ(benches); k++) {
+		if (selected(benches[k].name))
+			benches[k].run();
+	}
+	return 0;
+}
@@ -0,0 +1,523 @@
+/**
+ * Copyright (C) 2018 socware.net.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://socware.net
+ */
+
+/*
+ * Host (Linux) stand-in for the parts of the hyperC kernel used by
+ * libposix. Tasks are Linux threads, and every kernel object is guarded by
+ * its own futex lock. Blocked tasks wait on a futex in a wait record that
+ * lives on their own stack, so wakeups never touch the object again.
+ *
+ * libposix defines pthread_create, clock_gettime and friends itself, which
+ * interposes the C library symbols of the same name. The few C library
+ * functions the stand-in depends on are therefore looked up with RTLD_NEXT.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "hcos/core.h"
+#include "hcos/dbg.h"
+#include "hcos/mq.h"
+#include "hcos/mut.h"
+#include "hcos/sem.h"
+#include "hcos/task.h"
+#include "hcos/tmr.h"
+
+#define NS_PER_SEC  1000000000LL
+
+typedef struct kwait {
+	lle_t ll;
+	task_t *t;
+	int done;
+} kwait_t;
+
+unsigned tmr_hz = CFG_TMR_HZ;
+
+__thread task_t *_task_cur;
+
+static task_t main_task = {.name = "main" };
+
+static struct timespec t0;
+
+static int (*real_pthread_create) (pthread_t *, const pthread_attr_t *,
+				   void *(*)(void *), void *);
+
+static int (*real_clock_gettime) (clockid_t, struct timespec *);
+
+static void (*real_pthread_exit) (void *) __attribute__ ((noreturn));
+
+static void *real_sym(const char *name)
+{
+	void *p = dlsym(RTLD_NEXT, name);
+	if (!p) {
+		fprintf(stderr, "hcos: missing %s\n", name);
+		abort();
+	}
+	return p;
+}
+
+__attribute__ ((constructor))
+static void hcos_host_init(void)
+{
+	real_pthread_create = real_sym("pthread_create");
+	real_pthread_exit = real_sym("pthread_exit");
+	real_clock_gettime = real_sym("clock_gettime");
+	real_clock_gettime(CLOCK_MONOTONIC, &t0);
+	_task_cur = &main_task;
+}
+
+void _assert_fail(const char *file, int line)
+{
+	fprintf(stderr, "hcos: assert %s:%d\n", file, line);
+	abort();
+}
+
+static int futex_wait(int *addr, int val, const struct timespec *dl)
+{
+	// dl is an absolute CLOCK_MONOTONIC deadline, 0 to wait forever.
+	if (syscall(SYS_futex, addr, FUTEX_WAIT_BITSET_PRIVATE, val, dl, 0,
+		    FUTEX_BITSET_MATCH_ANY) == 0)
+		return 0;
+	return errno;
+}
+
+static void futex_wake(int *addr, int n)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, 0, 0, 0);
+}
+
+static void klock(int *lk)
+{
+	int c = 0;
+	if (__atomic_compare_exchange_n(lk, &c, 1, 0, __ATOMIC_ACQUIRE,
+					__ATOMIC_RELAXED))
+		return;
+	if (c != 2)
+		c = __atomic_exchange_n(lk, 2, __ATOMIC_ACQUIRE);
+	while (c) {
+		futex_wait(lk, 2, 0);
+		c = __atomic_exchange_n(lk, 2, __ATOMIC_ACQUIRE);
+	}
+}
+
+static void kunlock(int *lk)
+{
+	if (__atomic_exchange_n(lk, 0, __ATOMIC_RELEASE) == 2)
+		futex_wake(lk, 1);
+}
+
+static struct timespec *kdeadline(unsigned ticks, struct timespec *dl)
+{
+	long long ns;
+	if (ticks == WAIT)
+		return 0;
+	real_clock_gettime(CLOCK_MONOTONIC, dl);
+	ns = dl->tv_nsec + (long long)ticks * (NS_PER_SEC / tmr_hz);
+	dl->tv_sec += ns / NS_PER_SEC;
+	dl->tv_nsec = ns % NS_PER_SEC;
+	return dl;
+}
+
+/**
+ * Queue the caller on wq and block until kdone() or the deadline.
+ * Called with *lk held, returns with it released.
+ *
+ * @return 0 if woken, -1 on timeout.
+ */
+static int kblock(int *lk, ll_t * wq, const struct timespec *dl)
+{
+	kwait_t w;
+	w.t = _task_cur;
+	w.done = 0;
+	ll_addt(wq, &w.ll);
+	kunlock(lk);
+	while (!__atomic_load_n(&w.done, __ATOMIC_ACQUIRE)) {
+		if (futex_wait(&w.done, 0, dl) == ETIMEDOUT) {
+			int done;
+			klock(lk);
+			if (!(done = w.done))
+				lle_del(&w.ll);
+			kunlock(lk);
+			return done ? 0 : -1;
+		}
+	}
+	return 0;
+}
+
+static kwait_t *kpop(ll_t * wq)
+{
+	lle_t *e = ll_head(wq);
+	if (!e)
+		return 0;
+	lle_del(e);
+	return lle_get(e, kwait_t, ll);
+}
+
+/**
+ * Mark a popped waiter woken. Called with the object lock held; pass the
+ * result to kwake() once the lock is released, so the object is no longer
+ * touched when the woken task runs and possibly frees it.
+ */
+static int *kdone(kwait_t * w)
+{
+	__atomic_store_n(&w->done, 1, __ATOMIC_RELEASE);
+	return &w->done;
+}
+
+static void kwake(int *done)
+{
+	// The waiter may already be gone, a stray wake is harmless.
+	if (done)
+		futex_wake(done, 1);
+}
+
+static void *task_entry(void *p)
+{
+	task_t *t = (task_t *) p;
+	_task_cur = t;
+	t->fn(t->priv);
+	// The Linux thread never touches t or the stack again.
+	__atomic_store_n(&t->status, TASK_DEAD, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void task_exit(void)
+{
+	__atomic_store_n(&_task_cur->status, TASK_DEAD, __ATOMIC_RELEASE);
+	real_pthread_exit(0);
+}
+
+int task_init(task_t * t,
+	      const char *name,
+	      void (*fn) (void *priv),
+	      int pri, unsigned *stack, int stack_sz, int slice, void *priv)
+{
+	pthread_t th;
+	t->priv = priv;
+	t->name = name;
+	t->fn = fn;
+	t->pri = pri;
+	t->slice = slice;
+	t->stack = stack;
+	t->stack_sz = stack_sz;
+	t->status = 0;
+	if (real_pthread_create(&th, 0, task_entry, t) != 0)
+		return -1;
+	pthread_detach(th);
+	return 0;
+}
+
+void task_pri(task_t * t, int pri)
+{
+	t->pri = pri;
+}
+
+void task_yield(void)
+{
+	syscall(SYS_sched_yield);
+}
+
+void task_sleep(unsigned ticks)
+{
+	int dummy = 0;
+	struct timespec dl;
+	if (ticks == 0) {
+		task_yield();
+		return;
+	}
+	kdeadline(ticks, &dl);
+	while (futex_wait(&dummy, 0, &dl) != ETIMEDOUT) ;
+}
+
+core_t *core_idle(void)
+{
+	static core_t idle;
+	return &idle;
+}
+
+void mut_init(mut_t * m)
+{
+	m->own = 0;
+	m->cnt = 0;
+	m->lk = 0;
+	ll_init(&m->wq);
+}
+
+int mut_lock(mut_t * m, unsigned ticks)
+{
+	struct timespec dl;
+	klock(&m->lk);
+	if (!m->own) {
+		m->own = _task_cur;
+		m->cnt = 1;
+	} else if (m->own == _task_cur) {
+		m->cnt++;
+	} else if (ticks == WAIT_NO) {
+		kunlock(&m->lk);
+		return -1;
+	} else {
+		return kblock(&m->lk, &m->wq, kdeadline(ticks, &dl));
+	}
+	kunlock(&m->lk);
+	return 0;
+}
+
+int mut_unlock(mut_t * m)
+{
+	kwait_t *w;
+	int *wk = 0;
+	klock(&m->lk);
+	if (m->own != _task_cur) {
+		kunlock(&m->lk);
+		return -1;
+	}
+	if (--m->cnt == 0) {
+		if ((w = kpop(&m->wq)) != 0) {
+			m->own = w->t;
+			m->cnt = 1;
+			wk = kdone(w);
+		} else {
+			m->own = 0;
+		}
+	}
+	kunlock(&m->lk);
+	kwake(wk);
+	return 0;
+}
+
+void sem_init(sem_t * s, int val)
+{
+	s->val = val;
+	s->lk = 0;
+	ll_init(&s->wq);
+}
+
+int sem_get(sem_t * s, unsigned ticks)
+{
+	struct timespec dl;
+	klock(&s->lk);
+	if (s->val > 0) {
+		s->val--;
+	} else if (ticks == WAIT_NO) {
+		kunlock(&s->lk);
+		return -1;
+	} else {
+		return kblock(&s->lk, &s->wq, kdeadline(ticks, &dl));
+	}
+	kunlock(&s->lk);
+	return 0;
+}
+
+int sem_post_n(sem_t * s, int n)
+{
+	kwait_t *w;
+	int *wk;
+	while (n-- > 0) {
+		wk = 0;
+		klock(&s->lk);
+		if ((w = kpop(&s->wq)) != 0)
+			wk = kdone(w);
+		else
+			s->val++;
+		kunlock(&s->lk);
+		kwake(wk);
+	}
+	return 0;
+}
+
+int sem_post(sem_t * s)
+{
+	return sem_post_n(s, 1);
+}
+
+void mq_init(mq_t * q, int isz, void *buf, int bsz)
+{
+	q->isz = isz;
+	q->sz = bsz / (isz * sizeof(unsigned));
+	q->n = 0;
+	q->buf = q->r = q->w = (unsigned *)buf;
+	q->end = q->buf + q->sz * isz;
+	q->lk = 0;
+	ll_init(&q->wput);
+	ll_init(&q->wget);
+}
+
+int mq_put(mq_t * q, unsigned *m, unsigned ticks)
+{
+	kwait_t *w;
+	int *wk = 0;
+	struct timespec dl, *pdl = kdeadline(ticks, &dl);
+	klock(&q->lk);
+	while (q->n >= q->sz) {
+		if (ticks == WAIT_NO) {
+			kunlock(&q->lk);
+			return -1;
+		}
+		if (kblock(&q->lk, &q->wput, pdl))
+			return -1;
+		klock(&q->lk);
+	}
+	memcpy(q->w, m, q->isz * sizeof(unsigned));
+	if ((q->w += q->isz) >= q->end)
+		q->w = q->buf;
+	q->n++;
+	if ((w = kpop(&q->wget)) != 0)
+		wk = kdone(w);
+	kunlock(&q->lk);
+	kwake(wk);
+	return 0;
+}
+
+int mq_get(mq_t * q, unsigned *m, unsigned ticks)
+{
+	kwait_t *w;
+	int *wk = 0;
+	struct timespec dl, *pdl = kdeadline(ticks, &dl);
+	klock(&q->lk);
+	while (q->n == 0) {
+		if (ticks == WAIT_NO) {
+			kunlock(&q->lk);
+			return -1;
+		}
+		if (kblock(&q->lk, &q->wget, pdl))
+			return -1;
+		klock(&q->lk);
+	}
+	memcpy(m, q->r, q->isz * sizeof(unsigned));
+	if ((q->r += q->isz) >= q->end)
+		q->r = q->buf;
+	q->n--;
+	if ((w = kpop(&q->wput)) != 0)
+		wk = kdone(w);
+	kunlock(&q->lk);
+	kwake(wk);
+	return 0;
+}
+
+static int tlk;
+
+static int tcb_lk;
+
+static int tseq;
+
+static ll_t tlist = {&tlist, &tlist };
+
+static task_t ttask;
+
+unsigned tmr_ticks_get(void)
+{
+	struct timespec ts;
+	long long ns;
+	real_clock_gettime(CLOCK_MONOTONIC, &ts);
+	ns = (ts.tv_sec - t0.tv_sec) * NS_PER_SEC + (ts.tv_nsec - t0.tv_nsec);
+	return (unsigned)(ns / (NS_PER_SEC / tmr_hz));
+}
+
+/**
+ * Timer task, runs the callbacks of expired timers in expiry order.
+ */
+static void tmr_task(void *priv)
+{
+	struct timespec dl;
+	klock(&tlk);
+	for (;;) {
+		lle_t *e = ll_head(&tlist);
+		int seq = tseq;
+		int left;
+		tmr_t *t;
+
+		if (!e) {
+			kunlock(&tlk);
+			futex_wait(&tseq, seq, 0);
+			klock(&tlk);
+			continue;
+		}
+		t = lle_get(e, tmr_t, ll);
+		left = (int)(t->expire - tmr_ticks);
+		if (left <= 0) {
+			lle_del(e);
+			kunlock(&tlk);
+			klock(&tcb_lk);
+			t->cb(t->p);
+			kunlock(&tcb_lk);
+			klock(&tlk);
+		} else {
+			kunlock(&tlk);
+			futex_wait(&tseq, seq, kdeadline(left, &dl));
+			klock(&tlk);
+		}
+	}
+}
+
+void tmr_init(tmr_t * t, void *p, int (*cb) (void *p))
+{
+	lle_init(&t->ll);
+	t->expire = 0;
+	t->p = p;
+	t->cb = cb;
+}
+
+void tmr_on(tmr_t * t, unsigned ticks)
+{
+	lle_t *e;
+	klock(&tlk);
+	if (!ttask.fn)
+		task_init(&ttask, "tmr", tmr_task, 0, 0, 0, 0, 0);
+	if (lle_linked(&t->ll))
+		lle_del(&t->ll);
+	t->expire = tmr_ticks + ticks;
+	ll_for_each(&tlist, e) {
+		if ((int)(lle_get(e, tmr_t, ll)->expire - t->expire) > 0)
+			break;
+	}
+	lle_add_before(e, &t->ll);
+	if (tlist.n == &t->ll) {
+		tseq++;
+		futex_wake(&tseq, 1);
+	}
+	kunlock(&tlk);
+}
+
+/**
+ * On target a timer callback cannot be interrupted by a task, wait for a
+ * running callback so the timer can be freed once this returns.
+ */
+void tmr_of(tmr_t * t)
+{
+	int outside = (_task_cur != &ttask);
+	if (outside)
+		klock(&tcb_lk);
+	klock(&tlk);
+	if (lle_linked(&t->ll))
+		lle_del(&t->ll);
+	kunlock(&tlk);
+	if (outside)
+		kunlock(&tcb_lk);
+}
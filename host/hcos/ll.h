@@ -0,0 +1,96 @@
+/**
+ * Copyright (C) 2018 socware.net.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://socware.net
+ */
+#ifndef _HCOS_HOST_LL
+#define _HCOS_HOST_LL
+
+#include <stddef.h>
+
+/*
+ * Circular doubly linked list. An unlinked element points to itself, so
+ * lle_linked() can tell whether it sits in a list.
+ */
+typedef struct lle {
+	struct lle *n, *p;
+} lle_t, ll_t;
+
+#define lle_get(_e, _type, _member) \
+	((_type *)((char *)(_e) - offsetof(_type, _member)))
+
+#define ll_for_each(_ll, _e) \
+	for ((_e) = (_ll)->n; (_e) != (_ll); (_e) = (_e)->n)
+
+#define ll_for_each_mod(_ll, _e, _t) \
+	for ((_e) = (_ll)->n, (_t) = (_e)->n; (_e) != (_ll); \
+	     (_e) = (_t), (_t) = (_e)->n)
+
+static inline void lle_init(lle_t * e)
+{
+	e->n = e->p = e;
+}
+
+static inline void ll_init(ll_t * ll)
+{
+	lle_init(ll);
+}
+
+static inline int ll_empty(ll_t * ll)
+{
+	return ll->n == ll;
+}
+
+static inline int lle_linked(lle_t * e)
+{
+	return e->n != e;
+}
+
+static inline lle_t *ll_head(ll_t * ll)
+{
+	return ll_empty(ll) ? 0 : ll->n;
+}
+
+static inline void lle_add_before(lle_t * pos, lle_t * e)
+{
+	e->n = pos;
+	e->p = pos->p;
+	pos->p->n = e;
+	pos->p = e;
+}
+
+static inline void ll_addt(ll_t * ll, lle_t * e)
+{
+	lle_add_before(ll, e);
+}
+
+static inline void ll_addh(ll_t * ll, lle_t * e)
+{
+	lle_add_before(ll->n, e);
+}
+
+static inline void lle_del(lle_t * e)
+{
+	e->p->n = e->n;
+	e->n->p = e->p;
+	lle_init(e);
+}
+
+#endif
@@ -0,0 +1,46 @@
+/**
+ * Copyright (C) 2018 socware.net.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://socware.net
+ */
+#ifndef _HCOS_HOST_MQ
+#define _HCOS_HOST_MQ
+
+#include "task.h"
+
+/*
+ * Fixed size message ring. Items are isz words, the ring holds sz items.
+ */
+typedef struct mq {
+	unsigned short sz;	///< Capacity in items.
+	unsigned short isz;	///< Item size in words.
+	unsigned short n;	///< Items queued.
+	unsigned *buf, *end, *r, *w;
+	int lk;
+	ll_t wput, wget;
+} mq_t;
+
+void mq_init(mq_t * q, int isz, void *buf, int bsz);
+
+int mq_put(mq_t * q, unsigned *m, unsigned ticks);
+
+int mq_get(mq_t * q, unsigned *m, unsigned ticks);
+
+#endif
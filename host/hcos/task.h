@@ -0,0 +1,75 @@
+/**
+ * Copyright (C) 2018 socware.net.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://socware.net
+ */
+#ifndef _HCOS_HOST_TASK
+#define _HCOS_HOST_TASK
+
+#include "cfg.h"
+#include "ll.h"
+#include "tmr.h"
+
+/*
+ * Every task is backed by a Linux thread. The caller supplied stack is
+ * recorded but the thread runs on a stack owned by the C library, and
+ * priorities and time slices are recorded but not enforced.
+ *
+ * A task ends by returning from fn or by calling task_exit. The kernel
+ * then sets TASK_DEAD in status as its last access; until then the task_t
+ * and the stack must stay untouched.
+ */
+typedef struct task {
+	void *priv;
+	const char *name;
+	void (*fn) (void *priv);
+	int pri;
+	int slice;
+	unsigned *stack;
+	unsigned stack_sz;
+	unsigned char status;
+} task_t;
+
+#define TASK_DEAD  0x1
+
+extern __thread task_t *_task_cur;
+
+int task_init(task_t * t,
+	      const char *name,
+	      void (*fn) (void *priv),
+	      int pri, unsigned *stack, int stack_sz, int slice, void *priv);
+
+void task_pri(task_t * t, int pri);
+
+void task_yield(void);
+
+void task_sleep(unsigned ticks);
+
+void task_exit(void) __attribute__ ((noreturn));
+
+/*
+ * Nonzero once t has ended, so its task_t and stack may be reused.
+ */
+static inline int task_dead(task_t * t)
+{
+	return __atomic_load_n(&t->status, __ATOMIC_ACQUIRE) & TASK_DEAD;
+}
+
+#endif
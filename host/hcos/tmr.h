@@ -0,0 +1,60 @@
+/**
+ * Copyright (C) 2018 socware.net.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://socware.net
+ */
+#ifndef _HCOS_HOST_TMR
+#define _HCOS_HOST_TMR
+
+#include "cfg.h"
+#include "ll.h"
+
+#define WAIT     ((unsigned)-1)	///< Block until the object is available.
+#define WAIT_NO  0		///< Do not block.
+
+typedef struct tmr {
+	lle_t ll;
+	unsigned expire;	///< Tick count at which the timer fires.
+	void *p;		///< Argument of cb.
+	int (*cb) (void *p);	///< Runs on the timer task.
+} tmr_t;
+
+extern unsigned tmr_hz;
+
+/*
+ * The host has no tick interrupt, the tick count is derived from
+ * CLOCK_MONOTONIC whenever it is read.
+ */
+#define tmr_ticks  tmr_ticks_get()
+
+unsigned tmr_ticks_get(void);
+
+void tmr_init(tmr_t * t, void *p, int (*cb) (void *p));
+
+void tmr_on(tmr_t * t, unsigned ticks);
+
+void tmr_of(tmr_t * t);
+
+static inline int tmr_active(tmr_t * t)
+{
+	return lle_linked(&t->ll);
+}
+
+#endif
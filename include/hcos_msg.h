@@ -0,0 +1,120 @@
+/**
+ * Copyright (C) 2018 socware.net.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://socware.net
+ */
+
+/**
+ * @file hcos_msg.h
+ * @brief Synchronous send/receive/reply message passing.
+ *
+ * A client blocks in msg_send until a server has taken its request with
+ * msg_receive and answered it with msg_reply. Requests and replies are
+ * copied once, straight between the two threads' buffers, and the server
+ * runs at the client's priority while it holds the request.
+ */
+
+#ifndef _HCOS_POSIX_MSG_H_
+#define _HCOS_POSIX_MSG_H_
+
+#include <sys/types.h>
+#include <time.h>
+#include "hcos_types.h"
+
+/**
+ * @brief Initialize a channel.
+ *
+ * @return 0.
+ */
+int msg_chan_init(msg_chan_t * ch);
+
+/**
+ * @brief Destroy a channel.
+ *
+ * @return 0 on success; -1 with errno set to EBUSY if a client or server
+ * is still waiting on it.
+ */
+int msg_chan_destroy(msg_chan_t * ch);
+
+/**
+ * @brief Send a request and wait for the reply.
+ *
+ * @param[in] ch The channel.
+ * @param[in] req Request bytes, copied to the server's buffer.
+ * @param[in] req_len Request length.
+ * @param[out] rep Buffer for the reply.
+ * @param[in] rep_len Size of rep; a longer reply is truncated.
+ * @param[in] abstime Absolute CLOCK_REALTIME limit on waiting for a server
+ * to take the request; NULL waits forever.
+ *
+ * @return The reply length passed to msg_reply, which may exceed rep_len;
+ * -1 with errno set to EINVAL, ETIMEDOUT, or the error passed to
+ * msg_error.
+ *
+ * @note The timeout only covers the wait for a server. Once a server has
+ * received the request, the client waits for the answer however long it
+ * takes.
+ */
+ssize_t msg_send(msg_chan_t * ch, const void *req, size_t req_len,
+		 void *rep, size_t rep_len, const struct timespec *abstime);
+
+/**
+ * @brief Wait for a request.
+ *
+ * Clients are served most urgent first, in arrival order among equal
+ * priorities. The caller's priority is raised to the client's until the
+ * request is answered.
+ *
+ * @param[in] ch The channel.
+ * @param[out] buf Buffer for the request.
+ * @param[in] len Size of buf; a longer request is truncated.
+ * @param[out] rcvid Identifies the request to msg_reply or msg_error.
+ * @param[in] abstime Absolute CLOCK_REALTIME timeout; NULL waits forever.
+ *
+ * @return The request length, which may exceed len; -1 with errno set to
+ * EINVAL or ETIMEDOUT.
+ *
+ * @note Every received request must be answered exactly once. Each answer
+ * restores the priority the server had when it received that request, so
+ * a server holding several requests should answer the last one first.
+ */
+ssize_t msg_receive(msg_chan_t * ch, void *buf, size_t len,
+		    msg_rcvid_t * rcvid, const struct timespec *abstime);
+
+/**
+ * @brief Answer a request and release its client.
+ *
+ * @param[in] rcvid The request, from msg_receive.
+ * @param[in] rep Reply bytes, copied to the client's buffer.
+ * @param[in] rep_len Reply length, returned by the client's msg_send.
+ *
+ * @return 0.
+ */
+int msg_reply(msg_rcvid_t rcvid, const void *rep, size_t rep_len);
+
+/**
+ * @brief Fail a request; the client's msg_send returns -1 with errno set
+ * to err.
+ *
+ * @return 0.
+ */
+int msg_error(msg_rcvid_t rcvid, int err);
+
+#endif /* ifndef _HCOS_POSIX_MSG_H_ */
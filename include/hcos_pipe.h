@@ -0,0 +1,117 @@
+/**
+ * Copyright (C) 2018 socware.net.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://socware.net
+ */
+
+/**
+ * @file hcos_pipe.h
+ * @brief Byte stream pipes.
+ *
+ * A pipe moves bytes between threads through a single ring, with no
+ * message framing or alignment requirements. Reads and writes may
+ * transfer fewer bytes than asked for.
+ */
+
+#ifndef _HCOS_POSIX_PIPE_H_
+#define _HCOS_POSIX_PIPE_H_
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+#include "hcos_types.h"
+
+/**
+ * @brief Initialize a pipe with a ring of size bytes.
+ *
+ * @return 0 on success; -1 with errno set to EINVAL for a zero size, or
+ * ENOMEM.
+ */
+int pipe_init(pipe_t * pipe, size_t size);
+
+/**
+ * @brief Destroy a pipe.
+ *
+ * @return 0 on success; -1 with errno set to EBUSY while a thread is
+ * blocked on it.
+ */
+int pipe_destroy(pipe_t * pipe);
+
+/**
+ * @brief Set the wakeup thresholds.
+ *
+ * A blocked reader is only woken once rd_low bytes are buffered, and a
+ * blocked writer once wr_low bytes are free, or fewer if the call asked
+ * for less. Both default to 1. Raising them lets a stream move in chunks
+ * with one wakeup each.
+ *
+ * @return 0 on success; -1 with errno set to EINVAL if a threshold is 0 or
+ * larger than the ring.
+ */
+int pipe_setthreshold(pipe_t * pipe, size_t rd_low, size_t wr_low);
+
+/**
+ * @brief Read up to len bytes.
+ *
+ * Waits until the read threshold is met, then takes what is buffered.
+ *
+ * @param[in] pipe The pipe.
+ * @param[out] buf Destination.
+ * @param[in] len Size of buf.
+ * @param[in] abstime Absolute CLOCK_REALTIME timeout; NULL waits forever
+ * and a time in the past does not wait.
+ *
+ * @return The number of bytes read; -1 with errno set to EINVAL, or
+ * ETIMEDOUT if nothing was buffered by abstime.
+ *
+ * @note On timeout, the bytes already buffered are returned even if they
+ * fall short of the threshold.
+ */
+ssize_t pipe_read(pipe_t * pipe, void *buf, size_t len,
+		  const struct timespec *abstime);
+
+/**
+ * @brief Write up to len bytes.
+ *
+ * Waits until the write threshold is met, then writes as much as fits.
+ *
+ * @return The number of bytes written; -1 with errno set to EINVAL, or
+ * ETIMEDOUT if the ring stayed full until abstime.
+ */
+ssize_t pipe_write(pipe_t * pipe, const void *buf, size_t len,
+		   const struct timespec *abstime);
+
+/**
+ * @brief Scatter read into iovcnt buffers, filled in order.
+ *
+ * Behaves as pipe_read over the total length.
+ */
+ssize_t pipe_readv(pipe_t * pipe, const struct iovec *iov, int iovcnt,
+		   const struct timespec *abstime);
+
+/**
+ * @brief Gather write from iovcnt buffers, taken in order.
+ *
+ * Behaves as pipe_write over the total length.
+ */
+ssize_t pipe_writev(pipe_t * pipe, const struct iovec *iov, int iovcnt,
+		    const struct timespec *abstime);
+
+#endif /* ifndef _HCOS_POSIX_PIPE_H_ */
@@ -0,0 +1,131 @@
+/**
+ * Copyright (C) 2018 socware.net.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://socware.net
+ */
+
+/**
+ * @file hcos_pool.h
+ * @brief Worker thread pools.
+ *
+ * A pool starts a fixed number of threads up front and runs submitted jobs
+ * on them in submission order, so short jobs do not pay for a thread
+ * creation each. Idle workers block on the job count.
+ */
+
+#ifndef _HCOS_POSIX_POOL_H_
+#define _HCOS_POSIX_POOL_H_
+
+#include <sys/types.h>
+#include <time.h>
+#include "hcos_types.h"
+
+/**
+ * @brief Start a pool of nworkers threads with room for depth queued jobs.
+ *
+ * @param[out] pool The pool.
+ * @param[in] nworkers Worker threads.
+ * @param[in] depth Jobs that may wait for a worker.
+ * @param[in] stacksize Worker stack size; 0 for PTHREAD_STACK_MIN.
+ * @param[in] priority Worker sched_priority, as for pthread_attr_setschedparam.
+ *
+ * @return 0 on success; -1 with errno set to EINVAL for a zero nworkers or
+ * depth or a bad priority, or EAGAIN if the workers could not be created.
+ */
+int posix_pool_init(posix_pool_t * pool, unsigned nworkers, unsigned depth,
+		    size_t stacksize, int priority);
+
+/**
+ * @brief Stop a pool and join its workers.
+ *
+ * @param[in] pool The pool.
+ * @param[in] drain If nonzero, queued jobs are run first; otherwise they
+ * are discarded. Running jobs always finish.
+ *
+ * @return 0 on success; -1 with errno set to EINVAL if the pool is already
+ * being destroyed.
+ *
+ * @note Must not be called from a job of the same pool, nor while other
+ * threads may still submit to it.
+ */
+int posix_pool_destroy(posix_pool_t * pool, int drain);
+
+/**
+ * @brief Queue fn(arg) for the next free worker.
+ *
+ * @param[in] pool The pool.
+ * @param[in] fn Job function.
+ * @param[in] arg Passed to fn.
+ * @param[in] abstime Absolute CLOCK_REALTIME timeout while the queue is
+ * full; NULL waits forever and a time in the past does not wait.
+ *
+ * @return 0 on success; -1 with errno set to EINVAL (bad abstime, or the
+ * pool is being destroyed) or ETIMEDOUT.
+ */
+int posix_pool_submit(posix_pool_t * pool, void (*fn) (void *), void *arg,
+		      const struct timespec *abstime);
+
+/**
+ * @brief Queue fn(arg) only if the queue has room.
+ *
+ * @return 0 on success; -1 with errno set to EAGAIN if the queue is full,
+ * or EINVAL if the pool is being destroyed.
+ */
+int posix_pool_trysubmit(posix_pool_t * pool, void (*fn) (void *), void *arg);
+
+/**
+ * @brief Wait until every job submitted so far has finished.
+ *
+ * @param[in] pool The pool.
+ * @param[in] abstime Absolute CLOCK_REALTIME timeout; NULL waits forever.
+ *
+ * @return 0 once the pool is idle; -1 with errno set to EINVAL or
+ * ETIMEDOUT.
+ *
+ * @note Jobs submitted while waiting, including by other jobs, are waited
+ * for as well.
+ */
+int posix_pool_wait(posix_pool_t * pool, const struct timespec *abstime);
+
+/**
+ * @brief Run fn over [begin, end) on the calling thread and the workers.
+ *
+ * The range is split evenly over per-thread deques, one for the caller
+ * and one for each worker. Each thread runs chunks of grain iterations from
+ * the front of its own deque, and once it is empty steals half of what is
+ * left at the back of another, so uneven chunks keep every thread busy
+ * until the range is done. Workers busy with other jobs join when they
+ * get to it, and the caller alone is enough to finish.
+ *
+ * @param[in] pool The pool.
+ * @param[in] begin First index.
+ * @param[in] end One past the last index.
+ * @param[in] grain Iterations per chunk.
+ * @param[in] fn Called with chunks [lo, hi) and arg, concurrently.
+ * @param[in] arg Passed to fn.
+ *
+ * @return 0 once every chunk has run; -1 with errno set to EINVAL for a
+ * grain below 1, or ENOMEM.
+ */
+int posix_pool_parallel_for(posix_pool_t * pool, long begin, long end,
+			    long grain, void (*fn) (long lo, long hi,
+						    void *arg), void *arg);
+
+#endif /* ifndef _HCOS_POSIX_POOL_H_ */
@@ -29,6 +29,10 @@ typedef enum {
 	POSIX_STACK,
 	POSIX_MQUEUE,
 	POSIX_MQUEUE_BUF,
+	POSIX_NAME,
+	POSIX_TOPIC,
+	POSIX_PIPE,
+	POSIX_POOL,
 } posix_obj_t;
 
 typedef void *(*hcos_posix_alloc_t) (posix_obj_t type, unsigned sz);
@@ -50,8 +54,32 @@ static inline void hcos_posix_init(hcos_posix_alloc_t alloc,
 #define PTHREAD_STACK_MIN  (1024)
 #endif
 
-#ifndef POSIX_MQUEUE_NAME_SZ
-#define POSIX_MQUEUE_NAME_SZ   16
+#ifndef POSIX_THREAD_CACHE_MAX
+#define POSIX_THREAD_CACHE_MAX  4
+#endif
+
+#ifndef POSIX_THREAD_CACHE_CLASSES
+#define POSIX_THREAD_CACHE_CLASSES  4
+#endif
+
+// Fill pthread stacks with POSIX_STACK_PAINT_WORD at creation, so
+// pthread_getstackusage_np can tell how deep each stack has been used.
+#ifndef POSIX_STACK_PAINT
+#define POSIX_STACK_PAINT  0
+#endif
+
+#ifndef POSIX_STACK_PAINT_WORD
+#define POSIX_STACK_PAINT_WORD  0xCDCDCDCDu
+#endif
+
+// Thread specific data keys; each pthread carries one slot per key.
+#ifndef POSIX_THREAD_KEYS_MAX
+#define POSIX_THREAD_KEYS_MAX  8
+#endif
+
+// Passes over the keys at thread exit while destructors keep setting values.
+#ifndef POSIX_THREAD_DESTRUCTOR_ITERATIONS
+#define POSIX_THREAD_DESTRUCTOR_ITERATIONS  4
 #endif
 
 #ifndef POSIX_MQUEUE_DEF_MSG_MAX
@@ -62,8 +90,42 @@ static inline void hcos_posix_init(hcos_posix_alloc_t alloc,
 #define POSIX_MQUEUE_DEF_MSG_SZ  4
 #endif
 
+#ifndef POSIX_MQUEUE_MAX
+#define POSIX_MQUEUE_MAX  128
+#endif
+
+#ifndef POSIX_MQUEUE_PRIO_MAX
+#define POSIX_MQUEUE_PRIO_MAX  32
+#endif
+
+#if POSIX_MQUEUE_PRIO_MAX > 32
+#error POSIX_MQUEUE_PRIO_MAX must fit the 32 bit priority map
+#endif
+
+#ifndef POSIX_MQUEUE_POLL_MAX
+#define POSIX_MQUEUE_POLL_MAX  8
+#endif
+
+#ifndef POSIX_MQUEUE_STATS
+#define POSIX_MQUEUE_STATS  0
+#endif
+
+#ifndef POSIX_MQUEUE_STATS_BINS
+#define POSIX_MQUEUE_STATS_BINS  16
+#endif
+
+// Copy routine of the message queue data path, memcpy where the C
+// library has a faster one.
+#ifndef POSIX_MQUEUE_COPY
+#define POSIX_MQUEUE_COPY  mem_copy
+#endif
+
 #ifndef POSIX_NAME_MAX
 #define POSIX_NAME_MAX 64
 #endif
 
+#ifndef POSIX_NAME_HASH_SZ
+#define POSIX_NAME_HASH_SZ 32
+#endif
+
 #endif
@@ -0,0 +1,119 @@
+/**
+ * Copyright (C) 2018 socware.net.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://socware.net
+ */
+
+/**
+ * @file hcos_topic.h
+ * @brief Publish/subscribe topics with shared, reference counted buffers.
+ *
+ * A published message is copied once into a buffer of the topic, and every
+ * subscriber gets a reference to it on its own queue. The buffer returns to
+ * the topic when the last subscriber releases it.
+ */
+
+#ifndef _HCOS_POSIX_TOPIC_H_
+#define _HCOS_POSIX_TOPIC_H_
+
+#include <sys/types.h>
+#include <time.h>
+#include "hcos_types.h"
+
+/**
+ * @brief Initialize a topic with nbufs buffers of up to bufsize bytes.
+ *
+ * @return 0 on success; -1 with errno set to EINVAL for a zero nbufs, or
+ * ENOMEM.
+ *
+ * @note nbufs bounds the messages published but not yet released by every
+ * subscriber.
+ */
+int topic_init(topic_t * topic, unsigned nbufs, size_t bufsize);
+
+/**
+ * @brief Destroy a topic.
+ *
+ * @return 0 on success; -1 with errno set to EBUSY while it has
+ * subscribers or a buffer is still held.
+ */
+int topic_destroy(topic_t * topic);
+
+/**
+ * @brief Subscribe to a topic, queueing up to depth messages.
+ *
+ * Only messages published after this call are received.
+ *
+ * @return 0 on success; -1 with errno set to EINVAL for a zero depth, or
+ * ENOMEM.
+ */
+int topic_subscribe(topic_t * topic, topic_sub_t * sub, unsigned depth);
+
+/**
+ * @brief Cancel a subscription.
+ *
+ * Queued messages are released. Messages already received stay valid
+ * until they are passed to topic_release.
+ *
+ * @return 0.
+ */
+int topic_unsubscribe(topic_sub_t * sub);
+
+/**
+ * @brief Publish a message to every subscriber.
+ *
+ * Waits until a buffer is free, copies the message into it and queues a
+ * reference on each subscription. A subscriber whose queue is full misses
+ * the message, and its dropped count is incremented.
+ *
+ * @param[in] topic The topic.
+ * @param[in] msg The message.
+ * @param[in] len Message length, at most the topic bufsize.
+ * @param[in] abstime Absolute CLOCK_REALTIME limit on waiting for a free
+ * buffer; NULL waits forever.
+ *
+ * @return The number of subscribers the message was queued to; -1 with
+ * errno set to EINVAL, EMSGSIZE or ETIMEDOUT.
+ */
+int topic_publish(topic_t * topic, const void *msg, size_t len,
+		  const struct timespec *abstime);
+
+/**
+ * @brief Receive the next message of a subscription.
+ *
+ * @param[in] sub The subscription.
+ * @param[out] len Message length.
+ * @param[in] abstime Absolute CLOCK_REALTIME timeout; NULL waits forever.
+ *
+ * @return The shared message buffer, to be released with topic_release; 0
+ * with errno set to EINVAL or ETIMEDOUT.
+ */
+const void *topic_receive(topic_sub_t * sub, size_t * len,
+			  const struct timespec *abstime);
+
+/**
+ * @brief Release a message returned by topic_receive.
+ *
+ * @return 0 on success; -1 with errno set to EINVAL if msg is not a buffer
+ * of the subscription's topic.
+ */
+int topic_release(topic_sub_t * sub, const void *msg);
+
+#endif /* ifndef _HCOS_POSIX_TOPIC_H_ */
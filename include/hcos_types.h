@@ -58,6 +58,25 @@ typedef struct pthread_attr {
 	unsigned short status;	///< Schedule priority 15 bits (LSB) Detach state: 1 bits (MSB)
 } pthread_attr_t;
 
+/**
+ * @brief Signal value.
+ */
+union sigval {
+	int sival_int;///< Integer signal value.
+	void *sival_ptr; ///< Pointer signal value.
+};
+
+/**
+ * @brief Signal event structure.
+ */
+struct sigevent {
+	int sigev_notify;	///< Notification type. A value of SIGEV_SIGNAL is not supported.
+	int sigev_signo;	///< Signal number. This member is ignored.
+	union sigval sigev_value;	///< Signal value. Only the sival_ptr member is used.
+	void (*sigev_notify_function) (union sigval);	///< Notification function.
+	pthread_attr_t *sigev_notify_attributes;	///< Notification attributes.
+};
+
 typedef struct pthread_barrier {
 	unsigned cur_thread;	///< Current number of threads that have entered barrier.
 	unsigned threshold;	///< The count argument of pthread_barrier_init.
@@ -69,6 +88,8 @@ typedef void *pthread_barrierattr_t;
 
 typedef void *pthread_t;
 
+typedef unsigned int pthread_key_t;
+
 typedef void *pthread_condattr_t;
 
 typedef struct pthread_mutexattr {
@@ -88,25 +109,206 @@ typedef struct pthread_cond {
 	int waiting;		///< The number of threads currently waiting on this condition variable.
 } pthread_cond_t;
 
+typedef struct posix_name {
+	lle_t ll;		///< Registry bucket chain.
+	unsigned hash;
+	unsigned short len;
+	const char *str;	///< Interned copy owned by the registry.
+} posix_name_t;
+
+typedef struct mq_msg {
+	struct mq_msg *next;
+	unsigned short len;	///< Payload bytes.
+	unsigned char prio;
+	unsigned char flags;	///< Ring bookkeeping of MQ_VARLEN queues.
+#if POSIX_MQUEUE_STATS
+	unsigned stamp;		///< tmr_ticks when the message was queued.
+#endif
+} mq_msg_t;
+
+/**
+ * @brief Message queue statistics, kept when POSIX_MQUEUE_STATS is set.
+ */
+typedef struct mq_stats {
+	unsigned sends;		///< Messages queued.
+	unsigned receives;	///< Messages taken off the queue.
+	unsigned send_blocks;	///< Times a sender slept waiting for room.
+	unsigned send_block_ticks;	///< Ticks senders spent asleep.
+	unsigned recv_blocks;	///< Times a receiver slept waiting for a message.
+	unsigned recv_block_ticks;	///< Ticks receivers spent asleep.
+	unsigned depth_max;	///< Most messages ever queued at once.
+	/// Ticks from send to receive. Bin 0 counts 0 ticks, bin b counts
+	/// [2^(b-1), 2^b) ticks, and the last bin everything longer.
+	unsigned latency[POSIX_MQUEUE_STATS_BINS];
+} mq_stats_t;
+
+/**
+ * @brief Flow control watermarks of a message queue, see mq_setwatermark.
+ */
+typedef struct mq_watermark {
+	unsigned short high;	///< Depth at which the queue turns high; 0 disables.
+	unsigned short low;	///< Depth at which a high queue turns low again.
+	/// Called with MQ_WM_HIGH or MQ_WM_LOW at each crossing, may be NULL.
+	void (*func) (void *mqdes, int level, void *arg);
+	void *arg;		///< Passed to func.
+	sem_t *high_sem;	///< Posted when the queue turns high, may be NULL.
+	sem_t *low_sem;		///< Posted when the queue turns low, may be NULL.
+} mq_watermark_t;
+
 typedef struct mqd_internal {
-	mq_t q;
+	mut_t mux;		///< Guards the message and waiter lists.
+	mq_msg_t *head;		///< Queued messages, highest priority first.
+	mq_msg_t *tail[POSIX_MQUEUE_PRIO_MAX];	///< Last queued message of each priority.
+	unsigned prio_map;	///< Bit p is set while a message of priority p is queued.
+	mq_msg_t *free;		///< Unused message slots, fixed size queues only.
+	unsigned ring_sz;	///< Ring bytes of a MQ_VARLEN queue, 0 otherwise.
+	unsigned rd;		///< Offset of the oldest ring message; slot index for MQ_SPSC.
+	unsigned wr;		///< Offset of the next ring message; slot index for MQ_SPSC.
+	sem_t spsc_data;	///< A MQ_SPSC consumer sleeps here while the ring is empty.
+	sem_t spsc_room;	///< A MQ_SPSC producer sleeps here while the ring is full.
+	unsigned char data_wait;	///< Set while the MQ_SPSC consumer sleeps.
+	unsigned char room_wait;	///< Set while the MQ_SPSC producer sleeps.
+	unsigned short live;	///< Ring messages not yet reclaimed.
+	ll_t wsend;		///< Senders waiting for a free slot.
+	ll_t wrecv;		///< Receivers waiting for a message.
+	ll_t wpoll;		///< mq_poll callers watching the queue.
+	unsigned short n;	///< Number of queued messages.
+	unsigned short loaned;	///< Messages held by mq_reserve or mq_peek callers.
+	unsigned dropped;	///< Messages a MQ_OVERWRITE queue discarded.
+	unsigned short notify_on;	///< Set while a mq_notify registration is pending.
+	struct sigevent notify;	///< Registered by mq_notify.
+	mq_watermark_t wm;	///< Set by mq_setwatermark.
+	unsigned char wm_high;	///< Set from the high crossing to the low one.
+	unsigned char wm_busy;	///< Set while a thread delivers crossings.
+	unsigned short wm_seq;	///< Crossings so far.
+	unsigned short wm_done;	///< Crossings delivered or skipped.
+	unsigned short maxmsg;
+	unsigned short msgsize;	///< Largest message.
 	void *buf;
-	char name[POSIX_MQUEUE_NAME_SZ];
+	posix_name_t name;
 	long flags;
-	lle_t ll;
 	unsigned short open_count;
 	unsigned short pending_unlink;
+	unsigned short user_mem;	///< Set if mq_open_static got the control block and buffer.
+	unsigned short slot;	///< Index in the descriptor table.
+#if POSIX_MQUEUE_STATS
+	mq_stats_t stats;
+#endif
 } mqd_internal_t;
 
+/**
+ * @brief Rendezvous channel of msg_send, msg_receive and msg_reply.
+ */
+typedef struct msg_chan {
+	mut_t mux;		///< Guards the wait lists.
+	ll_t clients;		///< Senders no server has taken yet, most urgent first.
+	ll_t servers;		///< Servers waiting for a request.
+} msg_chan_t;
+
+/**
+ * @brief Names a received request until it is answered by msg_reply.
+ */
+typedef struct msg_client *msg_rcvid_t;
+
+/**
+ * @brief Shared message buffer of a topic, followed by the payload.
+ */
+typedef struct topic_buf {
+	struct topic_buf *next;	///< Free list link.
+	struct topic *topic;
+	unsigned ref;		///< Holders of the buffer, updated atomically.
+	unsigned len;		///< Payload bytes.
+} topic_buf_t;
+
+/**
+ * @brief Publish/subscribe topic.
+ */
+typedef struct topic {
+	mut_t mux;		///< Guards the subscriber list and the free buffers.
+	sem_t avail;		///< Counts free buffers.
+	topic_buf_t *free;
+	ll_t subs;
+	unsigned short nbufs;
+	unsigned short nfree;
+	unsigned short bufsize;	///< Largest message.
+	unsigned short slot_sz;	///< Bytes of a buffer and its header.
+	void *buf;
+} topic_t;
+
+/**
+ * @brief Subscription to a topic.
+ */
+typedef struct topic_sub {
+	lle_t ll;
+	topic_t *topic;
+	mq_t q;			///< References to published buffers.
+	void *qbuf;
+	unsigned dropped;	///< Messages missed because q was full.
+} topic_sub_t;
+
+/**
+ * @brief Byte stream between threads.
+ */
+typedef struct pipe {
+	mut_t mux;		///< Guards the ring and the wait lists.
+	char *buf;
+	unsigned size;		///< Ring bytes.
+	unsigned rd;		///< Offset of the oldest byte.
+	unsigned n;		///< Bytes buffered.
+	unsigned rd_low;	///< Bytes a blocked reader waits for.
+	unsigned wr_low;	///< Room a blocked writer waits for.
+	ll_t wread;		///< Blocked readers.
+	ll_t wwrite;		///< Blocked writers.
+} pipe_t;
+
+/**
+ * @brief Job queued on a worker pool.
+ */
+typedef struct posix_pool_job {
+	void (*fn) (void *arg);
+	void *arg;
+} posix_pool_job_t;
+
+/**
+ * @brief Fixed set of worker threads running jobs from a shared ring.
+ */
+typedef struct posix_pool {
+	mut_t mux;		///< Guards the ring, the counters and widle.
+	sem_t jobs;		///< Counts queued jobs; idle workers sleep here.
+	sem_t room;		///< Counts free ring slots; submitters sleep here.
+	posix_pool_job_t *ring;
+	pthread_t *workers;
+	unsigned short depth;	///< Ring slots.
+	unsigned short rd;	///< Slot of the next job to run.
+	unsigned short n;	///< Jobs queued.
+	unsigned short nworkers;
+	unsigned pending;	///< Jobs queued or running.
+	int stop;		///< Set once posix_pool_destroy has started.
+	ll_t widle;		///< posix_pool_wait callers.
+	struct pool_for *for_spare;	///< Idle posix_pool_parallel_for state.
+} posix_pool_t;
+
+/**
+ * @brief Stack use of a live thread, filled in by pthread_liststacks_np.
+ */
+typedef struct pthread_stackinfo_np {
+	pthread_t thread;
+	size_t size;		///< Bytes allocated for the stack.
+	size_t peak;		///< Most bytes ever used; 0 without POSIX_STACK_PAINT.
+} pthread_stackinfo_np_t;
+
 typedef struct pthread_internal {
 	pthread_attr_t attr;
 	void *(*fun) (void *);	///< Application thread function.
 	void *fun_arg;		///< Arguments for application thread function.
 	task_t task;
 	unsigned *stack;
+	unsigned stack_cap;	///< Bytes allocated for stack.
+	lle_t ll;		///< Link in the live list, or in the thread cache while idle.
 	sem_t barrier;		///< Synchronizes the two callers of pthread_join.
 	sem_t joined;		///< Synchronizes the two callers of pthread_join.
 	mut_t mux;		///< Ensures that only one other thread may join this thread.
 	void *ret;		///< Return value of fun.
+	void *specific[POSIX_THREAD_KEYS_MAX];	///< pthread_setspecific values.
 } pthread_internal_t;
 #endif
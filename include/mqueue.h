@@ -55,13 +55,81 @@
 #ifndef _HCOS_POSIX_MQUEUE_H_
 #define _HCOS_POSIX_MQUEUE_H_
 
+#include <signal.h>
 #include <time.h>
+#include "hcos_posix.h"
 
 /**
  * @brief Message queue descriptor.
  */
 typedef void *mqd_t;
 
+/**
+ * @brief Number of message priorities, 0 being the lowest.
+ */
+#define MQ_PRIO_MAX  POSIX_MQUEUE_PRIO_MAX
+
+/**
+ * @brief mq_open flag selecting variable-length message storage.
+ *
+ * Messages are packed into a byte ring with a small header each, instead of
+ * one mq_msgsize slot per message. mq_bufsize sets the ring size.
+ */
+#define MQ_VARLEN  0x40000000
+
+/**
+ * @brief mq_open flag selecting a single-producer/single-consumer ring.
+ *
+ * Send and receive use atomic ring indices only and fall back to a
+ * semaphore when the ring is full or empty, so the non-blocking path takes
+ * no lock and makes no kernel call. One thread or interrupt handler may
+ * send and one thread may receive. Messages are delivered in FIFO order;
+ * msg_prio is carried through but does not reorder them.
+ */
+#define MQ_SPSC    0x20000000
+
+/**
+ * @brief mq_open flag making a full queue drop messages instead of blocking.
+ *
+ * A send to a full queue discards the oldest message of the lowest queued
+ * priority to make room, so producers never wait and receivers get the
+ * newest data. Discarded messages are counted in mq_dropped. A MQ_VARLEN
+ * queue only regains ring space in arrival order, so it may drop more than
+ * one message to fit a new one.
+ */
+#define MQ_OVERWRITE 0x10000000
+
+/**
+ * @brief Control block of a queue created with mq_open_static.
+ */
+typedef mqd_internal_t mq_static_t;
+
+/**
+ * @brief Alignment of message slots, the message header size rounded up to
+ * a power of 2.
+ */
+#define MQ_MSG_ALIGN \
+	((sizeof(mq_msg_t) <= 8) ? 8 : (sizeof(mq_msg_t) <= 16) ? 16 : 32)
+
+/**
+ * @brief Bytes of one message slot holding up to _msgsize bytes.
+ *
+ * Each slot starts with a mq_msg_t header, which links the priority lists,
+ * and is rounded up to MQ_MSG_ALIGN. With 32 bit pointers that is 8 bytes
+ * of header, so a 4 byte message takes a 16 byte slot; with 64 bit
+ * pointers it takes 32.
+ */
+#define MQ_SLOT_SZ(_msgsize) \
+	((sizeof(mq_msg_t) + (_msgsize) + MQ_MSG_ALIGN - 1) & \
+	 ~(MQ_MSG_ALIGN - 1))
+
+/**
+ * @brief Buffer bytes mq_open_static needs for _maxmsg messages of up to
+ * _msgsize bytes, in any queue mode with the default mq_bufsize.
+ */
+#define MQ_STATIC_BUF_SZ(_maxmsg, _msgsize) \
+	(((_maxmsg) + 1) * MQ_SLOT_SZ(_msgsize) + MQ_MSG_ALIGN)
+
 /**
  * @brief Message queue attributes.
  */
@@ -70,6 +138,30 @@ struct mq_attr {
 	long mq_maxmsg;		///< Maximum number of messages.
 	long mq_msgsize;	///< Maximum message size.
 	long mq_curmsgs;	///< Number of messages currently queued.
+	long mq_bufsize;	///< Ring bytes of a MQ_VARLEN queue; 0 makes room for mq_maxmsg + 1 full messages.
+	long mq_dropped;	///< Messages discarded by a MQ_OVERWRITE queue.
+};
+
+/**
+ * @brief One message of mq_send_batch or mq_receive_batch.
+ */
+struct mq_msgvec {
+	char *msg_ptr;		///< Message buffer.
+	size_t msg_len;		///< Message length; buffer size on receive, updated with the message length.
+	unsigned msg_prio;	///< Message priority; set on receive.
+};
+
+#define MQ_POLLIN    0x1	///< A message can be received.
+#define MQ_POLLOUT   0x4	///< A message can be sent.
+#define MQ_POLLNVAL  0x20	///< The descriptor is invalid or cannot be polled.
+
+/**
+ * @brief One queue of mq_poll.
+ */
+struct mq_pollfd {
+	mqd_t mqdes;		///< Queue to watch.
+	short events;		///< MQ_POLLIN and/or MQ_POLLOUT.
+	short revents;		///< Set to the requested events that are ready, or MQ_POLLNVAL.
 };
 
 /**
@@ -86,22 +178,125 @@ int mq_close(mqd_t mqdes);
  */
 int mq_getattr(mqd_t mqdes, struct mq_attr *mqstat);
 
+/**
+ * @brief Get message queue statistics.
+ *
+ * @param[in] mqdes The message queue.
+ * @param[out] stats Counters since the queue was created or last reset.
+ * @param[in] reset If nonzero, clear the counters after reading them.
+ *
+ * @return 0 on success; -1 with errno set to EBADF for a bad descriptor, or
+ * ENOTSUP if libposix was built without POSIX_MQUEUE_STATS.
+ *
+ * @note Times are in ticks. On a MQ_SPSC queue the counters are updated
+ * without a lock, so a snapshot may be slightly inconsistent, and a reset
+ * should only be done while both sides are idle.
+ */
+int mq_getstats(mqd_t mqdes, mq_stats_t * stats, int reset);
+
+/**
+ * @brief Levels passed to the mq_watermark_t callback.
+ */
+#define MQ_WM_HIGH 1
+#define MQ_WM_LOW  2
+
+/**
+ * @brief Set the flow control watermarks of a message queue.
+ *
+ * The queue turns high when a send brings it to wm->high messages, and
+ * low again when receives bring it down to wm->low. Each crossing calls
+ * wm->func and posts the semaphore of that level, so producers can
+ * throttle before the queue fills and consumers can scale with the load.
+ *
+ * @param[in] mqdes The message queue.
+ * @param[in] wm The watermarks, copied; NULL or a zero high removes them.
+ *
+ * @return 0 on success; -1 with errno set to EBADF, or EINVAL if high is
+ * above mq_maxmsg, low is not below high, or the queue is MQ_SPSC.
+ *
+ * @note Crossings are delivered after the queue lock is released, one
+ * thread at a time and in the order they happened, so HIGH and LOW always
+ * alternate. They run in the context of the thread that caused them, or of
+ * one that is still delivering earlier ones, so func should be short and
+ * must not block. Setting the watermarks takes the current level without
+ * delivering it and drops crossings not yet delivered.
+ */
+int mq_setwatermark(mqd_t mqdes, const mq_watermark_t * wm);
+
+/**
+ * @brief Register for notification of a message arriving on an empty queue.
+ *
+ * http://pubs.opengroup.org/onlinepubs/9699919799/functions/mq_notify.html
+ *
+ * @note Only SIGEV_THREAD and SIGEV_NONE are supported; other types fail with
+ * EINVAL. Notification is delivered as for timer_create: without
+ * sigev_notify_attributes the function runs in the context of the sender,
+ * so it should only hand the event to a handler thread, such as by posting
+ * a semaphore. A queue holds one registration; it is removed when it fires,
+ * by mq_notify with a NULL notification, or by the last mq_close.
+ */
+int mq_notify(mqd_t mqdes, const struct sigevent *notification);
+
 /**
  * @brief Open a message queue.
  *
  * http://pubs.opengroup.org/onlinepubs/9699919799/functions/mq_open.html
  *
  * @note Currently, only the following oflags are implemented: O_RDWR, O_CREAT,
- * O_EXCL, and O_NONBLOCK. Also, mode is ignored.
+ * O_EXCL, and O_NONBLOCK. Also, mode is ignored. At most POSIX_MQUEUE_MAX
+ * queues exist at a time; further creates fail with ENFILE.
+ *
+ * @note mq_maxmsg and mq_msgsize are limited to 65535, otherwise EINVAL is
+ * returned.
+ *
+ * @note A fixed size queue takes mq_maxmsg * MQ_SLOT_SZ(mq_msgsize) bytes,
+ * header and alignment included, rather than mq_maxmsg * mq_msgsize. Small
+ * messages pay the most: the default queue of 128 4 byte messages needs
+ * 2 KB with 32 bit pointers.
+ *
+ * @note With MQ_VARLEN, mq_maxmsg still bounds the number of queued messages
+ * but a full ring also blocks senders. mq_bufsize must exceed the space
+ * taken by one mq_msgsize message, otherwise EINVAL is returned. Without
+ * MQ_VARLEN, mq_bufsize is ignored and need not be set.
+ *
+ * @note MQ_SPSC cannot be combined with MQ_VARLEN or MQ_OVERWRITE. On a MQ_SPSC queue only
+ * the send and receive calls, mq_getattr, mq_getstats, mq_close and
+ * mq_unlink are available; the others fail with EINVAL.
  */
 mqd_t mq_open(const char *name, int oflag, mode_t mode, struct mq_attr *attr);
 
+/**
+ * @brief Create a message queue in caller-supplied memory.
+ *
+ * Works like mq_open with O_CREAT | O_EXCL, but nothing is allocated:
+ * the control block, the message buffer and the name string all belong
+ * to the caller, so queues can live in .bss or a dedicated RAM section.
+ * Other threads open the queue by name with mq_open as usual.
+ *
+ * @param[in] name Queue name. It is not copied and must stay valid while
+ * the queue exists.
+ * @param[in] cb Control block.
+ * @param[in] buf Message buffer, pointer aligned.
+ * @param[in] buf_sz Size of buf; MQ_STATIC_BUF_SZ is always enough, and
+ * MQ_VARLEN queues use all of it as their ring.
+ *
+ * @return The descriptor, or (mqd_t)-1 with errno set to EINVAL (bad name,
+ * attributes or buffer), EEXIST or ENFILE.
+ *
+ * @note The memory may be reused once the queue has been unlinked and
+ * closed by every opener.
+ */
+mqd_t mq_open_static(const char *name, int oflag, struct mq_attr *attr,
+		     mq_static_t *cb, void *buf, size_t buf_sz);
+
 /**
  * @brief Receive a message from a message queue.
  *
  * http://pubs.opengroup.org/onlinepubs/9699919799/functions/mq_receive.html
  *
- * @note msg_prio is ignored. Messages are not checked for corruption.
+ * @note The oldest message of the highest priority is received first, and
+ * the return value is the length it was sent with. Messages are not checked
+ * for corruption. msg_ptr may have any alignment.
  */
 ssize_t mq_receive(mqd_t mqdes,
 		   char *msg_ptr, size_t msg_len, unsigned int *msg_prio);
@@ -111,7 +306,8 @@ ssize_t mq_receive(mqd_t mqdes,
  *
  * http://pubs.opengroup.org/onlinepubs/9699919799/functions/mq_send.html
  *
- * @note msg_prio is ignored.
+ * @note msg_prio must be below MQ_PRIO_MAX, otherwise EINVAL is returned.
+ * msg_ptr may have any alignment.
  */
 int mq_send(mqd_t mqdes,
 	    const char *msg_ptr, size_t msg_len, unsigned msg_prio);
@@ -121,7 +317,9 @@ int mq_send(mqd_t mqdes,
  *
  * http://pubs.opengroup.org/onlinepubs/9699919799/functions/mq_timedreceive.html
  *
- * @note msg_prio is ignored. Messages are not checked for corruption.
+ * @note The oldest message of the highest priority is received first, and
+ * the return value is the length it was sent with. Messages are not checked
+ * for corruption.
  */
 ssize_t mq_timedreceive(mqd_t mqdes,
 			char *msg_ptr,
@@ -133,13 +331,102 @@ ssize_t mq_timedreceive(mqd_t mqdes,
  *
  * http://pubs.opengroup.org/onlinepubs/9699919799/functions/mq_timedsend.html
  *
- * @note msg_prio is ignored.
+ * @note msg_prio must be below MQ_PRIO_MAX, otherwise EINVAL is returned.
  */
 int mq_timedsend(mqd_t mqdes,
 		 const char *msg_ptr,
 		 size_t msg_len,
 		 unsigned msg_prio, const struct timespec *abstime);
 
+/**
+ * @brief Reserve room for a message to be built in place.
+ *
+ * Blocks like mq_timedsend while the queue is full. The returned buffer
+ * holds up to msg_len bytes and stays owned by the caller until mq_commit
+ * or mq_release.
+ *
+ * @return The message buffer, or NULL with errno set to EBADF, EMSGSIZE,
+ * EAGAIN or ETIMEDOUT.
+ *
+ * @note Reserved messages count against mq_maxmsg. In a MQ_VARLEN queue
+ * they also hold back reclaiming the ring behind them.
+ */
+void *mq_reserve(mqd_t mqdes, size_t msg_len, const struct timespec *abstime);
+
+/**
+ * @brief Queue a message obtained from mq_reserve.
+ *
+ * @param[in] msg_len Bytes actually used, at most the reserved length.
+ *
+ * @return 0 on success; -1 with errno set to EBADF, EINVAL if msg is not
+ * reserved from this queue or msg_prio is out of range, or EMSGSIZE.
+ */
+int mq_commit(mqd_t mqdes, void *msg, size_t msg_len, unsigned msg_prio);
+
+/**
+ * @brief Take the next message without copying it out.
+ *
+ * The message is removed from the queue as with mq_timedreceive, but its
+ * buffer is lent to the caller until mq_release.
+ *
+ * @return The message buffer, or NULL with errno set to EBADF, EAGAIN or
+ * ETIMEDOUT.
+ */
+void *mq_peek(mqd_t mqdes, size_t *msg_len, unsigned *msg_prio,
+	      const struct timespec *abstime);
+
+/**
+ * @brief Return a buffer from mq_peek, or drop one from mq_reserve.
+ *
+ * @return 0 on success; -1 with errno set to EBADF or EINVAL.
+ */
+int mq_release(mqd_t mqdes, void *msg);
+
+/**
+ * @brief Send up to count messages with one call.
+ *
+ * Blocks like mq_timedsend until the first message fits, then queues as
+ * many of the rest as there is room for.
+ *
+ * @return The number of messages sent; -1 with errno set to EBADF, EINVAL
+ * (bad count or priority), EMSGSIZE, EAGAIN or ETIMEDOUT. Nothing is sent
+ * if any entry is invalid.
+ */
+int mq_send_batch(mqd_t mqdes, const struct mq_msgvec *vec, int count,
+		  const struct timespec *abstime);
+
+/**
+ * @brief Receive up to count messages with one call.
+ *
+ * Blocks like mq_timedreceive until a message is available, then takes as
+ * many more as are already queued, in priority order.
+ *
+ * @return The number of messages received; -1 with errno set to EBADF,
+ * EINVAL, EMSGSIZE (a buffer is smaller than mq_msgsize), EAGAIN or
+ * ETIMEDOUT.
+ */
+int mq_receive_batch(mqd_t mqdes, struct mq_msgvec *vec, int count,
+		     const struct timespec *abstime);
+
+/**
+ * @brief Wait until any of a set of queues is ready to receive or send.
+ *
+ * @param[in,out] fds The queues and the events to wait for; revents is
+ * set on return.
+ * @param[in] nfds Number of entries, at most POSIX_MQUEUE_POLL_MAX.
+ * @param[in] abstime Absolute CLOCK_REALTIME timeout; NULL waits forever,
+ * and a time in the past only checks the queues.
+ *
+ * @return The number of entries with revents set; 0 on timeout; -1 with
+ * errno set to EINVAL for a bad nfds or abstime.
+ *
+ * @note Readiness is a hint: another thread may take the message or the
+ * room first, so pair mq_poll with O_NONBLOCK descriptors. MQ_POLLOUT
+ * counts free messages, so on a MQ_VARLEN queue a large message may still
+ * not fit. MQ_SPSC queues cannot be polled and report MQ_POLLNVAL.
+ */
+int mq_poll(struct mq_pollfd *fds, int nfds, const struct timespec *abstime);
+
 /**
  * @brief Remove a message queue.
  *
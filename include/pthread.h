@@ -182,6 +182,102 @@ int pthread_barrier_init(pthread_barrier_t * barrier,
  */
 int pthread_barrier_wait(pthread_barrier_t * barrier);
 
+/**
+ * @brief Fill the thread cache ahead of pthread_create.
+ *
+ * Finished threads keep their object and stack in a cache bucketed by
+ * stack size, class c holding stacks of up to PTHREAD_STACK_MIN << c bytes
+ * for c below POSIX_THREAD_CACHE_CLASSES, so creating a thread reuses an
+ * idle thread of its class whose stack is big enough. Each class holds at
+ * most POSIX_THREAD_CACHE_MAX idle threads; larger stacks always come from
+ * hcos_posix_alloc.
+ *
+ * @param[in] stacksize Stack size the cached threads will be created with.
+ * @param[in] count Idle threads wanted in that class, capped at
+ * POSIX_THREAD_CACHE_MAX.
+ *
+ * @return 0 on success; EINVAL if stacksize has no class, or EAGAIN if
+ * memory ran out first.
+ */
+int pthread_cache_prewarm(size_t stacksize, unsigned count);
+
+/**
+ * @brief Get the stack size and peak stack use of a thread.
+ *
+ * With POSIX_STACK_PAINT set, pthread_create fills the whole stack with
+ * POSIX_STACK_PAINT_WORD, and the peak is the stack less the words at its
+ * far end that still hold the pattern. Stacks are taken to grow down.
+ *
+ * @param[in] thread The thread.
+ * @param[out] size Bytes allocated for the stack, which may be more than
+ * was asked for when a cached thread with a bigger stack was reused.
+ * @param[out] peak Most bytes of the stack ever used.
+ *
+ * @return 0 on success; EINVAL for a NULL argument, or ENOTSUP if libposix
+ * was built without POSIX_STACK_PAINT.
+ */
+int pthread_getstackusage_np(pthread_t thread, size_t * size, size_t * peak);
+
+/**
+ * @brief List every live thread with its stack size and peak use.
+ *
+ * A thread is live from pthread_create until it is joined, or until it
+ * ends if detached.
+ *
+ * @param[out] info Filled with up to max entries.
+ * @param[in] max Entries info has room for.
+ *
+ * @return Number of live threads, which may be more than max.
+ *
+ * @note The whole list is walked under the thread cache lock, and with
+ * POSIX_STACK_PAINT every stack is scanned, so avoid calling it from time
+ * critical threads.
+ */
+int pthread_liststacks_np(pthread_stackinfo_np_t * info, unsigned max);
+
+/**
+ * @brief Create a thread specific data key.
+ *
+ * http://pubs.opengroup.org/onlinepubs/9699919799/functions/pthread_key_create.html
+ *
+ * @return 0 on success; EAGAIN if all POSIX_THREAD_KEYS_MAX keys are in use.
+ *
+ * @note The new key reads NULL in every live thread. Its destructor runs
+ * when a thread ends with a non-NULL value for the key.
+ */
+int pthread_key_create(pthread_key_t * key, void (*destructor) (void *));
+
+/**
+ * @brief Delete a thread specific data key.
+ *
+ * http://pubs.opengroup.org/onlinepubs/9699919799/functions/pthread_key_delete.html
+ *
+ * @return 0 on success; EINVAL if key is not in use.
+ *
+ * @note No destructors are run; freeing the values is up to the caller.
+ */
+int pthread_key_delete(pthread_key_t key);
+
+/**
+ * @brief Get the calling thread's value for a key.
+ *
+ * http://pubs.opengroup.org/onlinepubs/9699919799/functions/pthread_getspecific.html
+ *
+ * @return The value, or NULL if none was set, key is out of range, or the
+ * caller was not started by pthread_create.
+ */
+void *pthread_getspecific(pthread_key_t key);
+
+/**
+ * @brief Set the calling thread's value for a key.
+ *
+ * http://pubs.opengroup.org/onlinepubs/9699919799/functions/pthread_setspecific.html
+ *
+ * @return 0 on success; EINVAL if key is not in use or the caller was not
+ * started by pthread_create.
+ */
+int pthread_setspecific(pthread_key_t key, const void *value);
+
 /**
  * @brief Thread creation.
  *
@@ -249,7 +345,7 @@ int pthread_equal(pthread_t t1, pthread_t t2);
  *
  * http://pubs.opengroup.org/onlinepubs/9699919799/functions/pthread_exit.html
  */
-void pthread_exit(void *value_ptr);
+void pthread_exit(void *value_ptr) __attribute__ ((noreturn));
 
 /**
  * @brief Dynamic thread scheduling parameters access.
@@ -346,6 +442,9 @@ int pthread_mutexattr_settype(pthread_mutexattr_t * attr, int type);
  * @brief Get the calling thread ID.
  *
  * http://pubs.opengroup.org/onlinepubs/9699919799/functions/pthread_self.html
+ *
+ * @return The calling thread, or NULL if the caller is a task that was not
+ * started by pthread_create.
  */
 pthread_t pthread_self(void);
 
@@ -63,23 +63,4 @@
 #define SIGEV_SIGNAL    1 ///< A queued signal, with an application-defined value, is generated when the event of interest occurs. Not supported.
 #define SIGEV_THREAD    2 ///< A notification function is called to perform notification.
 
-/**
- * @brief Signal value.
- */
-union sigval {
-	int sival_int;///< Integer signal value.
-	void *sival_ptr; ///< Pointer signal value.
-};
-
-/**
- * @brief Signal event structure.
- */
-struct sigevent {
-	int sigev_notify;	///< Notification type. A value of SIGEV_SIGNAL is not supported.
-	int sigev_signo;	///< Signal number. This member is ignored.
-	union sigval sigev_value;	///< Signal value. Only the sival_ptr member is used.
-	void (*sigev_notify_function) (union sigval);	///< Notification function.
-	pthread_attr_t *sigev_notify_attributes;	///< Notification attributes.
-};
-
 #endif /* ifndef _HCOS_POSIX_SIGNAL_H_ */
@@ -50,12 +50,81 @@
 #include <fcntl.h>
 #include <mqueue.h>
 #include <semaphore.h>
+#include <signal.h>
+#include "posix_name.h"
 #include "utils.h"
 
-static ll_t allq;
+#define SLOT_REF_MASK   0x7fff
+#define SLOT_DEAD       0x8000
+#define SLOT_GEN_SHFT   16
+#define SLOT_GEN_MASK   0x7fff
+
+#define MSG_DATA(_m)    ((void *)((_m) + 1))
+#define MSG_SZ(_len)    ((sizeof(mq_msg_t) + (_len) + MQ_MSG_ALIGN - 1) & \
+			 ~(MQ_MSG_ALIGN - 1))
+#define MSG_AT(_mq, _o) ((mq_msg_t *)((char *)(_mq)->buf + (_o)))
+
+#define MSG_FREE        0x1
+#define MSG_WRAP        0x2
+#define MSG_RESERVED    0x4
+#define MSG_PEEKED      0x8
+
+/**
+ * @brief Message queue descriptor table entry.
+ *
+ * A mqd_t encodes a slot index and the slot generation, so validating a
+ * descriptor is a single table lookup. state packs the generation, a dead
+ * flag set once the queue is removed, and the number of calls currently
+ * using the queue. The queue is freed by whoever drops the last reference
+ * of a dead slot, so send and receive never take allq_mux.
+ */
+typedef struct mq_slot {
+	mqd_internal_t *mq;
+	unsigned state;
+} mq_slot_t;
+
+/**
+ * @brief A thread blocked on a queue, linked on wsend or wrecv.
+ *
+ * Lives on the waiting thread's stack. The waker unlinks it and sets woken
+ * under mq->mux, so a waiter that times out can tell whether it lost the
+ * race against a wakeup. A receiver may offer its buffer, which a sender
+ * finding the queue empty fills directly, clearing buf.
+ */
+typedef struct mq_waiter {
+	lle_t ll;
+	sem_t sem;
+	int woken;
+	char *buf;		///< Receiver buffer offered for a direct handoff, or NULL.
+	size_t len;		///< Length of the message handed off.
+	unsigned prio;		///< Priority of the message handed off.
+} mq_waiter_t;
+
+/**
+ * @brief A mq_poll caller, woken by any queue it watches.
+ *
+ * woken is set by the first waker and cleared by the poller before each
+ * scan of its queues, so one wakeup is posted per scan.
+ */
+typedef struct mq_poller {
+	sem_t sem;
+	int woken;
+} mq_poller_t;
+
+/**
+ * @brief Links a mq_poller_t on the wpoll list of one queue.
+ */
+typedef struct mq_poll_link {
+	lle_t ll;
+	mq_poller_t *poller;
+} mq_poll_link_t;
+
+static posix_names_t allq;
 
 static mut_t allq_mux;
 
+static mq_slot_t slots[POSIX_MQUEUE_MAX];
+
 static int inited;
 /**
  * @brief Convert an absolute timespec into a tick timeout, taking into account
@@ -141,39 +210,836 @@ static void mq_check_init()
 {
 	if (inited)
 		return;
-	ll_init(&allq);
+	posix_names_init(&allq);
 	mut_init(&allq_mux);
 	inited = 1;
 }
 
-static mqd_internal_t *mq_extract_locked(mqd_t _mq)
+static mqd_t mq_handle(mqd_internal_t * mq)
 {
-	lle_t *p;
-	ll_for_each(&allq, p) {
-		mqd_internal_t *mq = lle_get(p, mqd_internal_t, ll);
-		if (mq == _mq) {
-			return mq;
+	unsigned gen = slots[mq->slot].state >> SLOT_GEN_SHFT;
+	return (mqd_t) (uintptr_t) ((gen << SLOT_GEN_SHFT) | (mq->slot + 1));
+}
+
+/**
+ * @brief Validate a descriptor and take a reference on its queue.
+ *
+ * @return The queue, or 0 if the descriptor is stale or invalid.
+ */
+static mqd_internal_t *mq_ref(mqd_t _mq)
+{
+	uintptr_t h = (uintptr_t) _mq;
+	unsigned idx = (h & 0xffff) - 1;
+	unsigned gen = h >> SLOT_GEN_SHFT;
+	mq_slot_t *slot;
+	unsigned st;
+
+	if ((h > 0x7fffffff) || (idx >= POSIX_MQUEUE_MAX)) {
+		return 0;
+	}
+	slot = &slots[idx];
+	st = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+	do {
+		if (((st >> SLOT_GEN_SHFT) != gen) || (st & SLOT_DEAD)) {
+			return 0;
+		}
+	} while (!__atomic_compare_exchange_n(&slot->state, &st, st + 1, 0,
+					      __ATOMIC_ACQUIRE,
+					      __ATOMIC_ACQUIRE));
+	return slot->mq;
+}
+
+static mqd_internal_t *mq_find_locked(const char *name, size_t len,
+				      unsigned hash)
+{
+	posix_name_t *n = posix_name_find(&allq, name, len, hash);
+	return n ? lle_get(n, mqd_internal_t, name) : 0;
+}
+
+/**
+ * @brief Bind a new queue to a free descriptor slot. Called with allq_mux.
+ *
+ * @return 0 on success; -1 if the table is full.
+ */
+static int mq_slot_alloc_locked(mqd_internal_t * mq)
+{
+	unsigned i, gen;
+	for (i = 0; i < POSIX_MQUEUE_MAX; i++) {
+		mq_slot_t *slot = &slots[i];
+		if (__atomic_load_n(&slot->mq, __ATOMIC_ACQUIRE) != 0) {
+			continue;
+		}
+		// Bump the generation so stale descriptors to this slot fail.
+		gen = ((slot->state >> SLOT_GEN_SHFT) + 1) & SLOT_GEN_MASK;
+		if (gen == 0) {
+			gen = 1;
+		}
+		mq->slot = i;
+		slot->mq = mq;
+		__atomic_store_n(&slot->state, gen << SLOT_GEN_SHFT,
+				 __ATOMIC_RELEASE);
+		return 0;
+	}
+	return -1;
+}
+
+/**
+ * @brief Carve a message out of the ring of a MQ_VARLEN queue.
+ *
+ * Messages are allocated in arrival order from wr. When the tail of the
+ * buffer is too short, a MSG_WRAP header marks the unused end and the
+ * message starts again at offset 0. Allocations never make wr catch up
+ * with rd, so wr == rd only while the ring is empty.
+ */
+static mq_msg_t *msg_alloc_ring_locked(mqd_internal_t * mq, size_t len)
+{
+	unsigned need = MSG_SZ(len);
+	unsigned at;
+
+	if (mq->live == 0) {
+		mq->rd = mq->wr = 0;
+	}
+	if (mq->wr >= mq->rd) {
+		if (mq->ring_sz - mq->wr >= need) {
+			at = mq->wr;
+		} else if (need < mq->rd) {
+			if (mq->ring_sz - mq->wr >= sizeof(mq_msg_t)) {
+				MSG_AT(mq, mq->wr)->flags = MSG_WRAP;
+			}
+			at = 0;
+		} else {
+			return 0;
 		}
+	} else if (need < mq->rd - mq->wr) {
+		at = mq->wr;
+	} else {
+		return 0;
+	}
+	mq->wr = at + need;
+	mq->live++;
+	return MSG_AT(mq, at);
+}
+
+/**
+ * @brief Release a ring message and reclaim the space in front of rd.
+ *
+ * Messages leave in priority order, so a freed message may sit behind
+ * an older one still queued. Its space comes back once everything before
+ * it has been received.
+ */
+static void msg_free_ring_locked(mqd_internal_t * mq, mq_msg_t * m)
+{
+	m->flags |= MSG_FREE;
+	while ((m = MSG_AT(mq, mq->rd))->flags & MSG_FREE) {
+		mq->rd += MSG_SZ(m->len);
+		if (--mq->live == 0) {
+			mq->rd = mq->wr = 0;
+			break;
+		}
+		if ((mq->ring_sz - mq->rd < sizeof(mq_msg_t)) ||
+		    (MSG_AT(mq, mq->rd)->flags & MSG_WRAP)) {
+			mq->rd = 0;
+		}
+	}
+}
+
+/**
+ * @brief Get storage for a len bytes message.
+ *
+ * @return The message, or 0 if the queue is full.
+ */
+static mq_msg_t *msg_alloc_locked(mqd_internal_t * mq, size_t len)
+{
+	mq_msg_t *m = 0;
+
+	if (mq->n + mq->loaned >= mq->maxmsg) {
+		return 0;
+	}
+	if (mq->flags & MQ_VARLEN) {
+		m = msg_alloc_ring_locked(mq, len);
+	} else {
+		m = mq->free;
+		mq->free = m->next;
+	}
+	if (m) {
+		m->len = len;
+		m->flags = 0;
+	}
+	return m;
+}
+
+/**
+ * @brief Shrink a ring message to len bytes.
+ *
+ * The space left over becomes a free gap message, which is reclaimed
+ * together with its neighbours. Sizes are multiples of MQ_MSG_ALIGN, which
+ * is no smaller than the header, so the gap always has room for its header.
+ */
+static void msg_trim_ring_locked(mqd_internal_t * mq, mq_msg_t * m,
+				 size_t len)
+{
+	unsigned gap = MSG_SZ(m->len) - MSG_SZ(len);
+	mq_msg_t *g;
+
+	m->len = len;
+	if (gap) {
+		g = (mq_msg_t *) ((char *)m + MSG_SZ(len));
+		g->len = gap - sizeof(mq_msg_t);
+		g->flags = MSG_FREE;
+		mq->live++;
+	}
+}
+
+static void msg_free_locked(mqd_internal_t * mq, mq_msg_t * m)
+{
+	if (mq->flags & MQ_VARLEN) {
+		msg_free_ring_locked(mq, m);
+	} else {
+		m->next = mq->free;
+		mq->free = m;
+	}
+}
+
+#if POSIX_MQUEUE_STATS
+/**
+ * @brief Account for a message just queued, depth being the new queue depth.
+ */
+static void mq_stat_send(mqd_internal_t * mq, mq_msg_t * m, unsigned depth)
+{
+	m->stamp = tmr_ticks;
+	mq->stats.sends++;
+	if (depth > mq->stats.depth_max) {
+		mq->stats.depth_max = depth;
+	}
+}
+
+/**
+ * @brief Account for a message taken off the queue.
+ */
+static void mq_stat_recv(mqd_internal_t * mq, mq_msg_t * m)
+{
+	unsigned t = tmr_ticks - m->stamp;
+	unsigned b = t ? 32 - __builtin_clz(t) : 0;
+
+	mq->stats.receives++;
+	if (b >= POSIX_MQUEUE_STATS_BINS) {
+		b = POSIX_MQUEUE_STATS_BINS - 1;
+	}
+	mq->stats.latency[b]++;
+}
+
+/**
+ * @brief Account for a sender or receiver that slept since start.
+ */
+static void mq_stat_block(mqd_internal_t * mq, int send, unsigned start)
+{
+	if (send) {
+		mq->stats.send_blocks++;
+		mq->stats.send_block_ticks += tmr_ticks - start;
+	} else {
+		mq->stats.recv_blocks++;
+		mq->stats.recv_block_ticks += tmr_ticks - start;
+	}
+}
+
+/**
+ * @brief Account for a message handed straight to a waiting receiver.
+ */
+static void mq_stat_handoff(mqd_internal_t * mq)
+{
+	mq->stats.sends++;
+	mq->stats.receives++;
+	mq->stats.latency[0]++;
+}
+#else
+#define mq_stat_send(_mq, _m, _depth)
+#define mq_stat_handoff(_mq)
+#define mq_stat_recv(_mq, _m)
+#define mq_stat_block(_mq, _send, _start)
+#endif
+
+/**
+ * @brief Follow the watermark state after the depth changed.
+ *
+ * Each crossing bumps wm_seq; mq_wm_deliver hands them out in order.
+ */
+static void mq_wm_update_locked(mqd_internal_t * mq)
+{
+	if (mq->wm.high == 0) {
+		return;
+	}
+	if (!mq->wm_high && (mq->n >= mq->wm.high)) {
+		mq->wm_high = 1;
+		mq->wm_seq++;
+	} else if (mq->wm_high && (mq->n <= mq->wm.low)) {
+		mq->wm_high = 0;
+		mq->wm_seq++;
+	}
+}
+
+/**
+ * @brief Queue a message behind all messages of the same or higher priority.
+ *
+ * The queue is a single list sorted by priority; tail[p] marks the end of
+ * the run of priority p, and prio_map tells which runs are present. The
+ * insertion point is the end of our own run, or failing that the end of
+ * the closest higher priority run, so both ends are O(1).
+ */
+static void msg_enqueue_locked(mqd_internal_t * mq, mq_msg_t * m)
+{
+	unsigned p = m->prio;
+	unsigned above = mq->prio_map & ~((2u << p) - 1);
+	mq_msg_t *prev = 0;
+
+	if (mq->prio_map & (1u << p)) {
+		prev = mq->tail[p];
+	} else if (above) {
+		prev = mq->tail[__builtin_ctz(above)];
+	}
+	if (prev) {
+		m->next = prev->next;
+		prev->next = m;
+	} else {
+		m->next = mq->head;
+		mq->head = m;
+	}
+	mq->tail[p] = m;
+	mq->prio_map |= 1u << p;
+	mq->n++;
+	mq_stat_send(mq, m, mq->n);
+	mq_wm_update_locked(mq);
+}
+
+/**
+ * @brief Remove the oldest message of the highest priority.
+ *
+ * The queue must not be empty.
+ */
+static mq_msg_t *msg_dequeue_locked(mqd_internal_t * mq)
+{
+	mq_msg_t *m = mq->head;
+
+	mq->head = m->next;
+	if (mq->tail[m->prio] == m) {
+		mq->prio_map &= ~(1u << m->prio);
+	}
+	mq->n--;
+	mq_stat_recv(mq, m);
+	mq_wm_update_locked(mq);
+	return m;
+}
+
+/**
+ * @brief Remove the oldest message of the lowest queued priority.
+ *
+ * That run sits at the end of the list, just behind the tail of the next
+ * higher run, so this is O(1) as well. The queue must not be empty.
+ */
+static mq_msg_t *msg_drop_locked(mqd_internal_t * mq)
+{
+	unsigned p = __builtin_ctz(mq->prio_map);
+	unsigned above = mq->prio_map & ~((2u << p) - 1);
+	mq_msg_t *prev = above ? mq->tail[__builtin_ctz(above)] : 0;
+	mq_msg_t *m = prev ? prev->next : mq->head;
+
+	if (prev) {
+		prev->next = m->next;
+	} else {
+		mq->head = m->next;
+	}
+	if (mq->tail[p] == m) {
+		mq->prio_map &= ~(1u << p);
+	}
+	mq->n--;
+	mq_wm_update_locked(mq);
+	return m;
+}
+
+/**
+ * @brief Sleep on a wait list until woken or the timeout expires.
+ *
+ * Called and returns with mq->mux held. timeout is updated with the ticks
+ * left, so callers can loop until their condition holds.
+ *
+ * @return 0 if woken; -1 on timeout.
+ */
+static int mq_sleep_locked(mqd_internal_t * mq, ll_t * wl, mq_waiter_t * w,
+			   unsigned *timeout)
+{
+	unsigned start = tmr_ticks;
+	unsigned elapsed;
+
+	if (*timeout == 0) {
+		return -1;
+	}
+	sem_init(&w->sem, 0);
+	w->woken = 0;
+	lle_init(&w->ll);
+	ll_addt(wl, &w->ll);
+	mut_unlock(&mq->mux);
+	sem_get(&w->sem, *timeout);
+	mut_lock(&mq->mux, WAIT);
+	mq_stat_block(mq, wl == &mq->wsend, start);
+	if (!w->woken) {
+		lle_del(&w->ll);
+		*timeout = 0;
+		return -1;
+	}
+	if (*timeout != WAIT) {
+		elapsed = tmr_ticks - start;
+		*timeout = (elapsed < *timeout) ? *timeout - elapsed : 0;
 	}
 	return 0;
 }
 
-static mqd_internal_t *mq_find_locked(const char *name)
+static int mq_wait_locked(mqd_internal_t * mq, ll_t * wl, unsigned *timeout)
+{
+	mq_waiter_t w;
+
+	w.buf = 0;
+	return mq_sleep_locked(mq, wl, &w, timeout);
+}
+
+/**
+ * @brief Wake every mq_poll caller watching the queue.
+ *
+ * Pollers stay linked and check the queue again themselves, so they never
+ * take a wakeup meant for a blocked sender or receiver.
+ */
+static void mq_poll_wake_locked(mqd_internal_t * mq)
+{
+	lle_t *p;
+
+	ll_for_each(&mq->wpoll, p) {
+		mq_poller_t *w = lle_get(p, mq_poll_link_t, ll)->poller;
+		if (!__atomic_exchange_n(&w->woken, 1, __ATOMIC_ACQ_REL)) {
+			sem_post(&w->sem);
+		}
+	}
+}
+
+/**
+ * @brief Wake the first thread on a wait list, if any.
+ */
+static void mq_wake_one_locked(ll_t * wl)
 {
 	lle_t *p;
-	ll_for_each(&allq, p) {
-		mqd_internal_t *mq = lle_get(p, mqd_internal_t, ll);
-		if (strcmp(name, mq->name) == 0) {
-			return mq;
+
+	ll_for_each(wl, p) {
+		mq_waiter_t *w = lle_get(p, mq_waiter_t, ll);
+		lle_del(p);
+		w->woken = 1;
+		sem_post(&w->sem);
+		break;
+	}
+}
+
+/**
+ * @brief Wake the first thread on a wait list, if any, and the pollers.
+ */
+static void mq_wake_locked(mqd_internal_t * mq, ll_t * wl)
+{
+	mq_wake_one_locked(wl);
+	if (!ll_empty(&mq->wpoll)) {
+		mq_poll_wake_locked(mq);
+	}
+}
+
+/**
+ * @brief Wake up to n threads from a wait list, and the pollers once if n
+ * messages moved.
+ */
+static void mq_wake_n_locked(mqd_internal_t * mq, ll_t * wl, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; (i < n) && !ll_empty(wl); i++) {
+		mq_wake_one_locked(wl);
+	}
+	if ((n != 0) && !ll_empty(&mq->wpoll)) {
+		mq_poll_wake_locked(mq);
+	}
+}
+
+/**
+ * @brief Allocate a message, waiting up to timeout ticks for room.
+ *
+ * @return The message, or 0 on timeout.
+ */
+static mq_msg_t *msg_alloc_wait_locked(mqd_internal_t * mq, size_t len,
+				       unsigned timeout)
+{
+	mq_msg_t *m;
+
+	while (!(m = msg_alloc_locked(mq, len))) {
+		// A lossy queue makes room by dropping queued messages. Only
+		// loaned messages can still make it wait.
+		if ((mq->flags & MQ_OVERWRITE) && (mq->n != 0)) {
+			msg_free_locked(mq, msg_drop_locked(mq));
+			mq->dropped++;
+			continue;
+		}
+		if (mq_wait_locked(mq, &mq->wsend, &timeout) != 0) {
+			break;
 		}
 	}
+	return m;
+}
+
+/**
+ * @brief Dequeue the next message, waiting up to timeout ticks for one.
+ *
+ * @return The message, or 0 on timeout.
+ */
+static mq_msg_t *msg_dequeue_wait_locked(mqd_internal_t * mq,
+					 unsigned timeout)
+{
+	while (mq->n == 0) {
+		if (mq_wait_locked(mq, &mq->wrecv, &timeout) != 0) {
+			return 0;
+		}
+	}
+	return msg_dequeue_locked(mq);
+}
+
+/**
+ * @brief Copy a message straight into the buffer of a blocked receiver.
+ *
+ * Only done while the queue is empty, when the first receiver would take
+ * this very message anyway, so the ring is skipped without reordering
+ * anything and neither pollers nor watermarks see a change.
+ *
+ * @return 1 if the message was handed off; 0 if it must be queued.
+ */
+static int msg_handoff_locked(mqd_internal_t * mq, const char *msg_ptr,
+			      size_t msg_len, unsigned msg_prio)
+{
+	lle_t *p = ll_head(&mq->wrecv);
+	mq_waiter_t *w;
+
+	if ((mq->n != 0) || !p || !(w = lle_get(p, mq_waiter_t, ll))->buf) {
+		return 0;
+	}
+	POSIX_MQUEUE_COPY(w->buf, msg_ptr, msg_len);
+	w->buf = 0;
+	w->len = msg_len;
+	w->prio = msg_prio;
+	lle_del(p);
+	w->woken = 1;
+	sem_post(&w->sem);
+	mq_stat_handoff(mq);
+	return 1;
+}
+
+/**
+ * @brief Receive a message into msg_ptr, waiting up to timeout ticks.
+ *
+ * While waiting, msg_ptr is offered to senders for msg_handoff_locked.
+ *
+ * @return The message length; -1 on timeout.
+ */
+static ssize_t msg_receive_locked(mqd_internal_t * mq, char *msg_ptr,
+				  unsigned *msg_prio, unsigned timeout)
+{
+	mq_waiter_t w;
+	mq_msg_t *m;
+	ssize_t len;
+
+	w.buf = msg_ptr;
+	while (mq->n == 0) {
+		if (mq_sleep_locked(mq, &mq->wrecv, &w, &timeout) != 0) {
+			return -1;
+		}
+		if (!w.buf) {
+			if (msg_prio) {
+				*msg_prio = w.prio;
+			}
+			return (ssize_t) w.len;
+		}
+	}
+	m = msg_dequeue_locked(mq);
+	POSIX_MQUEUE_COPY(msg_ptr, MSG_DATA(m), m->len);
+	len = (ssize_t) m->len;
+	if (msg_prio) {
+		*msg_prio = m->prio;
+	}
+	msg_free_locked(mq, m);
+	mq_wake_locked(mq, &mq->wsend);
+	return len;
+}
+
+/**
+ * @brief Take the pending notification for a message about to be queued.
+ *
+ * Called with mq->mux before the message is queued and before receivers are
+ * woken. The registration fires only if the queue is empty and nobody is
+ * blocked receiving, and is removed when it fires. The caller delivers ev
+ * after releasing mq->mux.
+ *
+ * @return 1 if ev must be delivered; 0 otherwise.
+ */
+static int mq_notify_take_locked(mqd_internal_t * mq, struct sigevent *ev)
+{
+	if (!mq->notify_on || (mq->n != 0) || !ll_empty(&mq->wrecv)) {
+		return 0;
+	}
+	mq->notify_on = 0;
+	*ev = mq->notify;
+	return 1;
+}
+
+/**
+ * @brief Claim the delivery of pending crossings.
+ *
+ * Called with mq->mux; the caller runs mq_wm_deliver after releasing it.
+ * Only one thread delivers at a time, so a thread that finds another one
+ * at it leaves its crossings to that one.
+ *
+ * @return 1 if the caller must call mq_wm_deliver; 0 otherwise.
+ */
+static int mq_wm_take_locked(mqd_internal_t * mq)
+{
+	if (mq->wm_busy || (mq->wm_seq == mq->wm_done)) {
+		return 0;
+	}
+	mq->wm_busy = 1;
+	return 1;
+}
+
+/**
+ * @brief Deliver pending crossings in the order they happened.
+ *
+ * Crossings alternate, and wm_high is the level after the last one, so the
+ * level of each pending crossing follows from its distance to wm_seq.
+ */
+static void mq_wm_deliver(mqd_t mqdes, mqd_internal_t * mq)
+{
+	unsigned short left;
+	mq_watermark_t wm;
+	sem_t *sem;
+	int edge;
+
+	mut_lock(&mq->mux, WAIT);
+	while ((left = (unsigned short)(mq->wm_seq - mq->wm_done)) != 0) {
+		edge = (mq->wm_high == (left & 1)) ? MQ_WM_HIGH : MQ_WM_LOW;
+		mq->wm_done++;
+		wm = mq->wm;
+		mut_unlock(&mq->mux);
+		if (wm.func) {
+			wm.func(mqdes, edge, wm.arg);
+		}
+		sem = (edge == MQ_WM_HIGH) ? wm.high_sem : wm.low_sem;
+		if (sem) {
+			sem_post(sem);
+		}
+		mut_lock(&mq->mux, WAIT);
+	}
+	mq->wm_busy = 0;
+	mut_unlock(&mq->mux);
+}
+
+static unsigned spsc_next(mqd_internal_t * mq, unsigned i)
+{
+	return (i == mq->maxmsg) ? 0 : i + 1;
+}
+
+/**
+ * @brief Messages in a MQ_SPSC ring between slot indices rd and wr.
+ */
+static unsigned spsc_count(mqd_internal_t * mq, unsigned wr, unsigned rd)
+{
+	return (wr >= rd) ? wr - rd : wr + mq->maxmsg + 1 - rd;
+}
+
+/**
+ * @brief Sleep until the other side of a MQ_SPSC ring moves its index.
+ *
+ * The producer (send set) waits for rd to move past blocked, the consumer
+ * for wr. The wait flag is raised before the index is checked again, and
+ * the other side clears it before posting, so a wakeup cannot be lost. A
+ * post left over from a timed out wait only costs the caller one more pass
+ * of its loop.
+ *
+ * @return 0 to check the ring again; -1 on timeout.
+ */
+static int spsc_sleep(mqd_internal_t * mq, int send, unsigned blocked,
+		      unsigned *timeout)
+{
+	sem_t *s = send ? &mq->spsc_room : &mq->spsc_data;
+	unsigned char *wait = send ? &mq->room_wait : &mq->data_wait;
+	unsigned *idx = send ? &mq->rd : &mq->wr;
+	unsigned start = tmr_ticks;
+	unsigned elapsed;
+	int ret;
+
+	if (*timeout == 0) {
+		return -1;
+	}
+	__atomic_store_n(wait, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(idx, __ATOMIC_SEQ_CST) != blocked) {
+		return 0;
+	}
+	ret = sem_get(s, *timeout);
+	mq_stat_block(mq, send, start);
+	if (ret != 0) {
+		__atomic_store_n(wait, 0, __ATOMIC_RELAXED);
+		return -1;
+	}
+	if (*timeout != WAIT) {
+		elapsed = tmr_ticks - start;
+		*timeout = (elapsed < *timeout) ? *timeout - elapsed : 0;
+	}
 	return 0;
 }
 
+/**
+ * @brief Send on a MQ_SPSC queue. Only the producer may call this.
+ *
+ * @return 0 on success; -1 on timeout.
+ */
+static int spsc_put(mqd_internal_t * mq, const char *msg_ptr, size_t msg_len,
+		    unsigned msg_prio, unsigned timeout)
+{
+	unsigned wr = mq->wr;
+	unsigned next = spsc_next(mq, wr);
+	mq_msg_t *m = MSG_AT(mq, wr * MSG_SZ(mq->msgsize));
+
+	while (next == __atomic_load_n(&mq->rd, __ATOMIC_ACQUIRE)) {
+		if (spsc_sleep(mq, 1, next, &timeout) != 0) {
+			return -1;
+		}
+	}
+	m->len = msg_len;
+	m->prio = msg_prio;
+	POSIX_MQUEUE_COPY(MSG_DATA(m), msg_ptr, msg_len);
+	mq_stat_send(mq, m, spsc_count(mq, next, mq->rd));
+	__atomic_store_n(&mq->wr, next, __ATOMIC_SEQ_CST);
+	if (__atomic_exchange_n(&mq->data_wait, 0, __ATOMIC_SEQ_CST)) {
+		sem_post(&mq->spsc_data);
+	}
+	return 0;
+}
+
+/**
+ * @brief Receive from a MQ_SPSC queue. Only the consumer may call this.
+ *
+ * @return The message length; -1 on timeout.
+ */
+static ssize_t spsc_get(mqd_internal_t * mq, char *msg_ptr,
+			unsigned *msg_prio, unsigned timeout)
+{
+	unsigned rd = mq->rd;
+	mq_msg_t *m = MSG_AT(mq, rd * MSG_SZ(mq->msgsize));
+	ssize_t len;
+
+	while (rd == __atomic_load_n(&mq->wr, __ATOMIC_ACQUIRE)) {
+		if (spsc_sleep(mq, 0, rd, &timeout) != 0) {
+			return -1;
+		}
+	}
+	len = m->len;
+	POSIX_MQUEUE_COPY(msg_ptr, MSG_DATA(m), len);
+	if (msg_prio) {
+		*msg_prio = m->prio;
+	}
+	mq_stat_recv(mq, m);
+	__atomic_store_n(&mq->rd, spsc_next(mq, rd), __ATOMIC_SEQ_CST);
+	if (__atomic_exchange_n(&mq->room_wait, 0, __ATOMIC_SEQ_CST)) {
+		sem_post(&mq->spsc_room);
+	}
+	return len;
+}
+
+/**
+ * @brief Set errno for a send or receive that could not complete in time.
+ */
+static void mq_timeout_errno(mqd_internal_t * mq)
+{
+	if (mq->flags & O_NONBLOCK) {
+		// Set errno to EAGAIN for nonblocking mq.
+		errno = EAGAIN;
+	} else {
+		// Otherwise, set errno to ETIMEDOUT.
+		errno = ETIMEDOUT;
+	}
+}
+
+/**
+ * @brief Map a loaned payload pointer back to its message.
+ *
+ * @return The message, or 0 if msg is not a loan of this queue carrying
+ * one of the flags in loan.
+ */
+static mq_msg_t *msg_loan_get(mqd_internal_t * mq, void *msg, unsigned loan)
+{
+	mq_msg_t *m = (mq_msg_t *) msg - 1;
+	unsigned buf_sz = mq->ring_sz ? mq->ring_sz :
+	    mq->maxmsg * MSG_SZ(mq->msgsize);
+
+	if (((char *)m < (char *)mq->buf) ||
+	    ((char *)m >= (char *)mq->buf + buf_sz) || !(m->flags & loan)) {
+		return 0;
+	}
+	return m;
+}
+
 static void mq_free(mqd_internal_t * mq)
 {
-	hcos_posix_free(POSIX_MQUEUE_BUF, mq->buf);
-	hcos_posix_free(POSIX_MQUEUE, mq);
+	mq_slot_t *slot = &slots[mq->slot];
+	// Static queues hand their memory back to the caller untouched.
+	if (!mq->user_mem) {
+		posix_name_free(&mq->name);
+		hcos_posix_free(POSIX_MQUEUE_BUF, mq->buf);
+		hcos_posix_free(POSIX_MQUEUE, mq);
+	}
+	__atomic_store_n(&slot->mq, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Drop a reference taken by mq_ref, freeing a removed queue.
+ */
+static void mq_unref(mqd_internal_t * mq)
+{
+	unsigned st = __atomic_sub_fetch(&slots[mq->slot].state, 1,
+					 __ATOMIC_ACQ_REL);
+	if ((st & SLOT_DEAD) && !(st & SLOT_REF_MASK)) {
+		mq_free(mq);
+	}
+}
+
+/**
+ * @brief mq_ref for calls built on the queue lock, which MQ_SPSC queues
+ * do not use.
+ *
+ * @return The queue, or 0 with errno set to EBADF or EINVAL.
+ */
+static mqd_internal_t *mq_ref_mux(mqd_t _mq)
+{
+	mqd_internal_t *mq = mq_ref(_mq);
+
+	if (!mq) {
+		errno = EBADF;
+	} else if (mq->flags & MQ_SPSC) {
+		mq_unref(mq);
+		errno = EINVAL;
+		mq = 0;
+	}
+	return mq;
+}
+
+/**
+ * @brief Invalidate the descriptors of a queue removed from allq.
+ *
+ * The queue is freed now if nobody is using it, otherwise by the last
+ * mq_unref.
+ */
+static void mq_retire(mqd_internal_t * mq)
+{
+	unsigned st = __atomic_or_fetch(&slots[mq->slot].state, SLOT_DEAD,
+					__ATOMIC_ACQ_REL);
+	if (!(st & SLOT_REF_MASK)) {
+		mq_free(mq);
+	}
 }
 
 int mq_close(mqd_t _mq)
@@ -182,27 +1048,30 @@ int mq_close(mqd_t _mq)
 	int removed = 0;
 	mqd_internal_t *mq = 0;
 	mq_check_init();
-	mut_lock(&allq_mux, WAIT);
-	if ((mq = mq_extract_locked(_mq)) != 0) {
+	if ((mq = mq_ref(_mq)) != 0) {
+		mut_lock(&allq_mux, WAIT);
 		if (mq->open_count > 0) {
 			mq->open_count--;
 		}
+		// The last close of an unlinked queue removes it.
+		if ((mq->open_count == 0) && mq->pending_unlink) {
+			removed = 1;
+		}
+		// The last close also drops a notification registration.
 		if (mq->open_count == 0) {
-			if (mq->pending_unlink) {
-				lle_del(&mq->ll);
-				removed = 1;
-			} else {
-				mq->pending_unlink = 1;
-			}
+			mut_lock(&mq->mux, WAIT);
+			mq->notify_on = 0;
+			mut_unlock(&mq->mux);
+		}
+		mut_unlock(&allq_mux);
+		if (removed) {
+			mq_retire(mq);
 		}
+		mq_unref(mq);
 	} else {
 		errno = EBADF;
 		ret = -1;
 	}
-	mut_unlock(&allq_mux);
-	if (removed) {
-		mq_free(mq);
-	}
 	return ret;
 }
 
@@ -210,25 +1079,154 @@ int mq_getattr(mqd_t _mq, struct mq_attr *mqstat)
 {
 	int ret = 0;
 	mqd_internal_t *mq = 0;
-	mq_check_init();
-	mut_lock(&allq_mux, WAIT);
-	if ((mq = mq_extract_locked(_mq)) != 0) {
+	if ((mq = mq_ref(_mq)) != 0) {
 		mqstat->mq_flags = mq->flags;
-		mqstat->mq_maxmsg = mq->q.sz;
-		mqstat->mq_msgsize = mq->q.isz;
-		mqstat->mq_curmsgs = mq->q.n;
+		mqstat->mq_maxmsg = mq->maxmsg;
+		mqstat->mq_msgsize = mq->msgsize;
+		mqstat->mq_curmsgs = mq->n;
+		if (mq->flags & MQ_SPSC) {
+			mqstat->mq_curmsgs =
+			    spsc_count(mq,
+				       __atomic_load_n(&mq->wr, __ATOMIC_ACQUIRE),
+				       __atomic_load_n(&mq->rd, __ATOMIC_ACQUIRE));
+		}
+		mqstat->mq_bufsize = mq->ring_sz;
+		mqstat->mq_dropped = mq->dropped;
+		mq_unref(mq);
 	} else {
 		errno = EBADF;
 		ret = -1;
 	}
-	mut_unlock(&allq_mux);
 	return ret;
 }
 
+int mq_getstats(mqd_t _mq, mq_stats_t * stats, int reset)
+{
+	int ret = 0;
+#if POSIX_MQUEUE_STATS
+	mqd_internal_t *mq = 0;
+	if ((mq = mq_ref(_mq)) != 0) {
+		mut_lock(&mq->mux, WAIT);
+		*stats = mq->stats;
+		if (reset) {
+			memset(&mq->stats, 0, sizeof(mq->stats));
+		}
+		mut_unlock(&mq->mux);
+		mq_unref(mq);
+	} else {
+		errno = EBADF;
+		ret = -1;
+	}
+#else
+	errno = ENOTSUP;
+	ret = -1;
+#endif
+	return ret;
+}
+
+/**
+ * @brief Check mq_open flags and attributes.
+ *
+ * @return 0 if they describe a valid queue; EINVAL otherwise.
+ */
+static int mq_attr_check(int oflag, const struct mq_attr *attr)
+{
+	int ret = 0;
+
+	if ((attr != 0)
+	    && ((attr->mq_maxmsg < 0) || (attr->mq_msgsize < 0))) {
+		// Invalid mq_attr.mq_maxmsg or mq_attr.mq_msgsize.
+		ret = EINVAL;
+	}
+	// mq_bufsize is ours, so only MQ_VARLEN callers are expected to have
+	// set it; others may leave it uninitialized.
+	if ((attr != 0) && (oflag & MQ_VARLEN)
+	    && ((attr->mq_bufsize < 0) || ((attr->mq_bufsize != 0)
+					   && (attr->mq_bufsize <=
+					       MSG_SZ(attr->mq_msgsize))))) {
+		ret = EINVAL;
+	}
+	// Counts and message sizes are kept in 16 bits, and the buffer size
+	// in an unsigned.
+	if ((attr != 0)
+	    && ((attr->mq_maxmsg > 0xffff) || (attr->mq_msgsize > 0xffff)
+		|| (((unsigned long long)attr->mq_maxmsg + 2) *
+		    MSG_SZ((unsigned long long)attr->mq_msgsize) > ~0u))) {
+		ret = EINVAL;
+	}
+	// A SPSC ring has fixed slots, and only the consumer moves rd.
+	if ((oflag & MQ_SPSC) && (oflag & (MQ_VARLEN | MQ_OVERWRITE))) {
+		ret = EINVAL;
+	}
+	return ret;
+}
+
+/**
+ * @brief Bytes of buffer needed by a queue with these attributes, mq_flags
+ * holding the mq_open flags.
+ */
+static unsigned mq_buf_size(const struct mq_attr *attr)
+{
+	unsigned slot_sz = MSG_SZ(attr->mq_msgsize);
+	unsigned buf_sz = attr->mq_maxmsg * slot_sz;
+
+	// A variable-length ring may be smaller than the worst case. By
+	// default the spare slot absorbs the unused end left by wrapping and
+	// the spare header keeps wr from catching up with rd.
+	if (attr->mq_flags & MQ_VARLEN) {
+		if (attr->mq_bufsize != 0) {
+			buf_sz = (attr->mq_bufsize + MQ_MSG_ALIGN - 1) &
+			    ~(MQ_MSG_ALIGN - 1);
+		} else {
+			buf_sz += slot_sz + MQ_MSG_ALIGN;
+		}
+	}
+	// rd == wr means empty, so a SPSC ring has one slot more than it
+	// can fill.
+	if (attr->mq_flags & MQ_SPSC) {
+		buf_sz += slot_sz;
+	}
+	return buf_sz;
+}
+
+/**
+ * @brief Set up the message storage of a new queue over buf.
+ */
+static void mq_setup(mqd_internal_t * mq, const struct mq_attr *attr,
+		     void *buf, unsigned buf_sz)
+{
+	unsigned slot_sz = MSG_SZ(attr->mq_msgsize);
+	mq_msg_t *m;
+	unsigned i;
+
+	mq->buf = buf;
+	mq->flags = attr->mq_flags;
+	mq->open_count = 1;
+	mq->maxmsg = attr->mq_maxmsg;
+	mq->msgsize = attr->mq_msgsize;
+	mut_init(&mq->mux);
+	ll_init(&mq->wsend);
+	ll_init(&mq->wrecv);
+	ll_init(&mq->wpoll);
+	sem_init(&mq->spsc_data, 0);
+	sem_init(&mq->spsc_room, 0);
+	if (mq->flags & MQ_VARLEN) {
+		mq->ring_sz = buf_sz & ~(MQ_MSG_ALIGN - 1);
+	} else if (!(mq->flags & MQ_SPSC)) {
+		for (i = 0; i < mq->maxmsg; i++) {
+			m = (mq_msg_t *) ((char *)buf + i * slot_sz);
+			m->next = mq->free;
+			mq->free = m;
+		}
+	}
+}
+
 mqd_t mq_open(const char *name, int oflag, mode_t mode, struct mq_attr * attr)
 {
 	mqd_internal_t *mq = 0;
+	mqd_t ret = (mqd_t) - 1;
 	size_t len = 0;
+	unsigned hash = 0;
 
 	struct mq_attr def_attr = {
 		.mq_flags = 0,
@@ -244,19 +1242,15 @@ mqd_t mq_open(const char *name, int oflag, mode_t mode, struct mq_attr * attr)
 		mq = (mqd_t) - 1;
 	}
 	// Check attributes, if given.
-	if (mq == 0) {
-		if ((attr != 0)
-		    && ((attr->mq_maxmsg < 0) || (attr->mq_msgsize < 0))) {
-			// Invalid mq_attr.mq_maxmsg or mq_attr.mq_msgsize.
-			errno = EINVAL;
-			mq = (mqd_t) - 1;
-		}
+	if ((mq == 0) && (mq_attr_check(oflag, attr) != 0)) {
+		errno = EINVAL;
+		mq = (mqd_t) - 1;
 	}
 
 	if (mq == 0) {
-
+		hash = posix_name_hash(name, len);
 		mut_lock(&allq_mux, WAIT);
-		mq = mq_find_locked(name);
+		mq = mq_find_locked(name, len, hash);
 		// Search the queue list to check if the queue exists.
 		if (mq != 0) {
 			// If the mq exists, check that this function wasn't called with
@@ -272,13 +1266,13 @@ mqd_t mq_open(const char *name, int oflag, mode_t mode, struct mq_attr * attr)
 			// Only create the new queue if O_CREAT was specified.
 			if (oflag & O_CREAT) {
 				unsigned buf_sz = 0;
-				unsigned nwords = 0;
 				// Copy attributes if provided.
 				if (attr != 0) {
 					def_attr = *attr;
 				}
 				// Copy oflags.
 				def_attr.mq_flags = (long)oflag;
+				buf_sz = mq_buf_size(&def_attr);
 
 				mq = hcos_posix_alloc(POSIX_MQUEUE,
 						      sizeof(mqd_internal_t));
@@ -289,31 +1283,101 @@ mqd_t mq_open(const char *name, int oflag, mode_t mode, struct mq_attr * attr)
 				}
 				memset(mq, 0, sizeof(mqd_internal_t));
 
-				nwords = (def_attr.mq_msgsize + 3) >> 2;
-				buf_sz = def_attr.mq_maxmsg * nwords;
 				mq->buf =
 				    hcos_posix_alloc(POSIX_MQUEUE_BUF, buf_sz);
 				if (!mq->buf) {
+					hcos_posix_free(POSIX_MQUEUE, mq);
 					errno = ENOENT;
 					mq = (mqd_t) - 1;
 					goto out;
 				}
-				memset(mq->buf, 0, buf_sz);
-				strcpy(mq->name, name);
-				mq->flags = def_attr.mq_flags;
-				lle_init(&mq->ll);
-				mq->open_count = 0;
-				mq_init(&mq->q, nwords, mq->buf, buf_sz);
+				if (mq_slot_alloc_locked(mq) != 0) {
+					// Descriptor table full.
+					hcos_posix_free(POSIX_MQUEUE_BUF,
+							mq->buf);
+					hcos_posix_free(POSIX_MQUEUE, mq);
+					errno = ENFILE;
+					mq = (mqd_t) - 1;
+					goto out;
+				}
+				if (posix_name_add(&allq, &mq->name, name, len,
+						   hash) != 0) {
+					mq_free(mq);
+					errno = ENOMEM;
+					mq = (mqd_t) - 1;
+					goto out;
+				}
+				mq_setup(mq, &def_attr, mq->buf, buf_sz);
 			} else {
 				errno = ENOENT;
 				mq = (mqd_t) - 1;
 			}
 		}
+out:
+		if (mq != (mqd_t) - 1) {
+			ret = mq_handle(mq);
+		}
 		mut_unlock(&allq_mux);
+	}
+	return ret;
+}
+
+mqd_t mq_open_static(const char *name, int oflag, struct mq_attr *attr,
+		     mq_static_t * cb, void *buf, size_t buf_sz)
+{
+	mqd_internal_t *mq = cb;
+	mqd_t ret = (mqd_t) - 1;
+	size_t len = 0;
+	unsigned hash = 0;
+	int err = 0;
 
+	struct mq_attr def_attr = {
+		.mq_flags = 0,
+		.mq_maxmsg = POSIX_MQUEUE_DEF_MSG_MAX,
+		.mq_msgsize = POSIX_MQUEUE_DEF_MSG_SZ,
+		.mq_curmsgs = 0
+	};
+	mq_check_init();
+
+	if (!validate_name(name, &len)) {
+		err = EINVAL;
+	} else if ((err = mq_attr_check(oflag, attr)) == 0) {
+		if (attr != 0) {
+			def_attr = *attr;
+		}
+		def_attr.mq_flags = (long)oflag;
+		// Message headers hold a pointer.
+		if (!cb || !buf || ((uintptr_t) buf & (sizeof(void *) - 1))
+		    || (buf_sz < mq_buf_size(&def_attr))) {
+			err = EINVAL;
+		}
 	}
-out:
-	return mq;
+
+	if (err == 0) {
+		hash = posix_name_hash(name, len);
+		mut_lock(&allq_mux, WAIT);
+		if (mq_find_locked(name, len, hash) != 0) {
+			// The control block cannot be shared with another open.
+			err = EEXIST;
+		} else {
+			memset(mq, 0, sizeof(mqd_internal_t));
+			mq->buf = buf;
+			mq->user_mem = 1;
+			if (mq_slot_alloc_locked(mq) != 0) {
+				err = ENFILE;
+			} else {
+				posix_name_ref(&allq, &mq->name, name, len,
+					       hash);
+				mq_setup(mq, &def_attr, buf, buf_sz);
+				ret = mq_handle(mq);
+			}
+		}
+		mut_unlock(&allq_mux);
+	}
+	if (err != 0) {
+		errno = err;
+	}
+	return ret;
 }
 
 ssize_t mq_receive(mqd_t mqdes,
@@ -333,24 +1397,19 @@ ssize_t mq_timedreceive(mqd_t _mq,
 			unsigned *msg_prio, const struct timespec * abstime)
 {
 	ssize_t ret = 0;
-	mqd_internal_t *mq;
+	mqd_internal_t *mq = 0;
+	int edge = 0;
 	int timeout_ret = 0;
 	unsigned timeout = 0;
 
-	mut_lock(&allq_mux, WAIT);
-	if (!(mq = mq_extract_locked(_mq))) {
-		// Queue not found; bad descriptor.
+	if (!(mq = mq_ref(_mq))) {
+		// Stale or invalid descriptor.
 		errno = EBADF;
 		ret = -1;
 	}
-	// msg_ptr must be word aligned
-	if ((unsigned)msg_ptr & 0x3) {
-		errno = EINVAL;
-		ret = -1;
-	}
 	// Verify that msg_len is large enough.
 	if (ret == 0) {
-		if (msg_len < (size_t) mq->q.isz) {
+		if (msg_len < (size_t) mq->msgsize) {
 			// msg_len too small.
 			errno = EMSGSIZE;
 			ret = -1;
@@ -365,25 +1424,26 @@ ssize_t mq_timedreceive(mqd_t _mq,
 			ret = -1;
 		}
 	}
-	mut_unlock(&allq_mux);
 
-	if (ret == 0) {
-		if (mq_get(&mq->q, (unsigned *)msg_ptr, timeout) != 0) {
-			// If queue receive fails, set the appropriate errno.
-			if (mq->flags & O_NONBLOCK) {
-				// Set errno to EAGAIN for nonblocking mq.
-				errno = EAGAIN;
-			} else {
-				// Otherwise, set errno to ETIMEDOUT.
-				errno = ETIMEDOUT;
-			}
-			ret = -1;
+	if ((ret == 0) && (mq->flags & MQ_SPSC)) {
+		if ((ret = spsc_get(mq, msg_ptr, msg_prio, timeout)) < 0) {
+			mq_timeout_errno(mq);
+		}
+	} else if (ret == 0) {
+		mut_lock(&mq->mux, WAIT);
+		ret = msg_receive_locked(mq, msg_ptr, msg_prio, timeout);
+		edge = mq_wm_take_locked(mq);
+		mut_unlock(&mq->mux);
+		if (edge) {
+			mq_wm_deliver(_mq, mq);
+		}
+		if (ret < 0) {
+			mq_timeout_errno(mq);
 		}
 	}
 
-	if (ret == 0) {
-		// Get the length of data for return value.
-		ret = (ssize_t) mq->q.isz;
+	if (mq) {
+		mq_unref(mq);
 	}
 
 	return ret;
@@ -395,29 +1455,33 @@ int mq_timedsend(mqd_t _mq,
 		 unsigned int msg_prio, const struct timespec *abstime)
 {
 	mqd_internal_t *mq = 0;
+	mq_msg_t *m = 0;
+	struct sigevent ev;
+	int notify = 0, edge = 0, handed = 0;
 	int ret = 0, timeout_ret = 0;
 	unsigned timeout = 0;
 
-	mut_lock(&allq_mux, WAIT);
 	// Find the mq referenced by mqdes.
-	if (!(mq = mq_extract_locked(_mq))) {
-		// Queue not found; bad descriptor.
+	if (!(mq = mq_ref(_mq))) {
+		// Stale or invalid descriptor.
 		errno = EBADF;
 		ret = -1;
 	}
-	// msg_ptr must be word aligned
-	if ((unsigned)msg_ptr & 0x3) {
-		errno = EINVAL;
-		ret = -1;
-	}
 	// Verify that mq_msgsize is large enough.
 	if (ret == 0) {
-		if (msg_len > (size_t) mq->q.isz) {
+		if (msg_len > (size_t) mq->msgsize) {
 			// msg_len too large.
 			errno = EMSGSIZE;
 			ret = -1;
 		}
 	}
+	// Priorities index the priority map.
+	if (ret == 0) {
+		if (msg_prio >= MQ_PRIO_MAX) {
+			errno = EINVAL;
+			ret = -1;
+		}
+	}
 
 	if (ret == 0) {
 		// Convert abstime to a tick timeout.
@@ -427,22 +1491,478 @@ int mq_timedsend(mqd_t _mq,
 			ret = -1;
 		}
 	}
-	mut_unlock(&allq_mux);
 
+	if ((ret == 0) && (mq->flags & MQ_SPSC)) {
+		if ((ret = spsc_put(mq, msg_ptr, msg_len, msg_prio, timeout)) != 0) {
+			mq_timeout_errno(mq);
+		}
+	} else if (ret == 0) {
+		mut_lock(&mq->mux, WAIT);
+		if (msg_handoff_locked(mq, msg_ptr, msg_len, msg_prio)) {
+			handed = 1;
+		} else if ((m = msg_alloc_wait_locked(mq, msg_len, timeout)) != 0) {
+			m->prio = msg_prio;
+			POSIX_MQUEUE_COPY(MSG_DATA(m), msg_ptr, msg_len);
+			notify = mq_notify_take_locked(mq, &ev);
+			msg_enqueue_locked(mq, m);
+			mq_wake_locked(mq, &mq->wrecv);
+		}
+		// Even a failed send may have dropped messages.
+		edge = mq_wm_take_locked(mq);
+		mut_unlock(&mq->mux);
+		if (notify) {
+			sigevent_dispatch(&ev);
+		}
+		if (edge) {
+			mq_wm_deliver(_mq, mq);
+		}
+		if (!m && !handed) {
+			mq_timeout_errno(mq);
+			ret = -1;
+		}
+	}
+	if (mq) {
+		mq_unref(mq);
+	}
+
+	return ret;
+}
+
+void *mq_reserve(mqd_t _mq, size_t msg_len, const struct timespec *abstime)
+{
+	mqd_internal_t *mq = 0;
+	mq_msg_t *m = 0;
+	int ret = 0, edge;
+	unsigned timeout = 0;
+
+	if (!(mq = mq_ref_mux(_mq))) {
+		ret = -1;
+	}
+	if ((ret == 0) && (msg_len > (size_t) mq->msgsize)) {
+		errno = EMSGSIZE;
+		ret = -1;
+	}
 	if (ret == 0) {
-		if (mq_put(&mq->q, (unsigned *)msg_ptr, timeout) != 0) {
-			// If queue send fails, set the appropriate errno.
-			if (mq->flags & O_NONBLOCK) {
-				// Set errno to EAGAIN for nonblocking mq.
-				errno = EAGAIN;
-			} else {
-				// Otherwise, set errno to ETIMEDOUT.
-				errno = ETIMEDOUT;
+		if ((ret = get_tick_timeout(mq->flags, abstime, &timeout)) != 0) {
+			errno = ret;
+			ret = -1;
+		}
+	}
+	if (ret == 0) {
+		mut_lock(&mq->mux, WAIT);
+		if ((m = msg_alloc_wait_locked(mq, msg_len, timeout)) != 0) {
+			m->flags |= MSG_RESERVED;
+			mq->loaned++;
+		}
+		// Room may have been made by dropping messages.
+		edge = mq_wm_take_locked(mq);
+		mut_unlock(&mq->mux);
+		if (edge) {
+			mq_wm_deliver(_mq, mq);
+		}
+		if (!m) {
+			mq_timeout_errno(mq);
+		}
+	}
+	if (mq) {
+		mq_unref(mq);
+	}
+	return m ? MSG_DATA(m) : 0;
+}
+
+int mq_commit(mqd_t _mq, void *msg, size_t msg_len, unsigned msg_prio)
+{
+	mqd_internal_t *mq = 0;
+	mq_msg_t *m = 0;
+	struct sigevent ev;
+	int notify = 0, edge = 0;
+	int ret = 0;
+
+	if (!(mq = mq_ref_mux(_mq))) {
+		return -1;
+	}
+	mut_lock(&mq->mux, WAIT);
+	if (!(m = msg_loan_get(mq, msg, MSG_RESERVED))) {
+		errno = EINVAL;
+		ret = -1;
+	} else if (msg_len > m->len) {
+		errno = EMSGSIZE;
+		ret = -1;
+	} else if (msg_prio >= MQ_PRIO_MAX) {
+		errno = EINVAL;
+		ret = -1;
+	} else {
+		if (mq->ring_sz) {
+			msg_trim_ring_locked(mq, m, msg_len);
+		} else {
+			m->len = msg_len;
+		}
+		m->flags &= ~MSG_RESERVED;
+		m->prio = msg_prio;
+		mq->loaned--;
+		notify = mq_notify_take_locked(mq, &ev);
+		msg_enqueue_locked(mq, m);
+		mq_wake_locked(mq, &mq->wrecv);
+		edge = mq_wm_take_locked(mq);
+	}
+	mut_unlock(&mq->mux);
+	if (notify) {
+		sigevent_dispatch(&ev);
+	}
+	if (edge) {
+		mq_wm_deliver(_mq, mq);
+	}
+	mq_unref(mq);
+	return ret;
+}
+
+void *mq_peek(mqd_t _mq, size_t * msg_len, unsigned *msg_prio,
+	      const struct timespec *abstime)
+{
+	mqd_internal_t *mq = 0;
+	mq_msg_t *m = 0;
+	int edge = 0;
+	int ret = 0;
+	unsigned timeout = 0;
+
+	if (!(mq = mq_ref_mux(_mq))) {
+		ret = -1;
+	}
+	if (ret == 0) {
+		if ((ret = get_tick_timeout(mq->flags, abstime, &timeout)) != 0) {
+			errno = ret;
+			ret = -1;
+		}
+	}
+	if (ret == 0) {
+		mut_lock(&mq->mux, WAIT);
+		if ((m = msg_dequeue_wait_locked(mq, timeout)) != 0) {
+			m->flags |= MSG_PEEKED;
+			mq->loaned++;
+			*msg_len = m->len;
+			if (msg_prio) {
+				*msg_prio = m->prio;
+			}
+			edge = mq_wm_take_locked(mq);
+		}
+		mut_unlock(&mq->mux);
+		if (edge) {
+			mq_wm_deliver(_mq, mq);
+		}
+		if (!m) {
+			mq_timeout_errno(mq);
+		}
+	}
+	if (mq) {
+		mq_unref(mq);
+	}
+	return m ? MSG_DATA(m) : 0;
+}
+
+int mq_release(mqd_t _mq, void *msg)
+{
+	mqd_internal_t *mq = 0;
+	mq_msg_t *m = 0;
+	int ret = 0;
+
+	if (!(mq = mq_ref_mux(_mq))) {
+		return -1;
+	}
+	mut_lock(&mq->mux, WAIT);
+	if (!(m = msg_loan_get(mq, msg, MSG_RESERVED | MSG_PEEKED))) {
+		errno = EINVAL;
+		ret = -1;
+	} else {
+		m->flags &= ~(MSG_RESERVED | MSG_PEEKED);
+		mq->loaned--;
+		msg_free_locked(mq, m);
+		mq_wake_locked(mq, &mq->wsend);
+	}
+	mut_unlock(&mq->mux);
+	mq_unref(mq);
+	return ret;
+}
+
+int mq_send_batch(mqd_t _mq, const struct mq_msgvec *vec, int count,
+		  const struct timespec *abstime)
+{
+	mqd_internal_t *mq = 0;
+	mq_msg_t *m = 0;
+	struct sigevent ev;
+	int notify = 0, edge = 0;
+	int ret = 0;
+	int i = 0;
+	unsigned timeout = 0;
+
+	if (!(mq = mq_ref_mux(_mq))) {
+		ret = -1;
+	}
+	if ((ret == 0) && (count < 0)) {
+		errno = EINVAL;
+		ret = -1;
+	}
+	// Check the whole batch up front so it is never cut short by a bad entry.
+	for (i = 0; (ret == 0) && (i < count); i++) {
+		if (vec[i].msg_len > (size_t) mq->msgsize) {
+			errno = EMSGSIZE;
+			ret = -1;
+		} else if (vec[i].msg_prio >= MQ_PRIO_MAX) {
+			errno = EINVAL;
+			ret = -1;
+		}
+	}
+	if ((ret == 0) && (count > 0)) {
+		if ((ret = get_tick_timeout(mq->flags, abstime, &timeout)) != 0) {
+			errno = ret;
+			ret = -1;
+		}
+	}
+	if ((ret == 0) && (count > 0)) {
+		mut_lock(&mq->mux, WAIT);
+		for (i = 0; i < count; i++) {
+			// Only the first message waits for room.
+			m = msg_alloc_wait_locked(mq, vec[i].msg_len,
+						  i ? 0 : timeout);
+			if (!m) {
+				break;
+			}
+			m->prio = vec[i].msg_prio;
+			POSIX_MQUEUE_COPY(MSG_DATA(m), vec[i].msg_ptr, vec[i].msg_len);
+			if (i == 0) {
+				notify = mq_notify_take_locked(mq, &ev);
+			}
+			msg_enqueue_locked(mq, m);
+		}
+		mq_wake_n_locked(mq, &mq->wrecv, i);
+		edge = mq_wm_take_locked(mq);
+		mut_unlock(&mq->mux);
+		if (notify) {
+			sigevent_dispatch(&ev);
+		}
+		if (edge) {
+			mq_wm_deliver(_mq, mq);
+		}
+		if (i == 0) {
+			mq_timeout_errno(mq);
+			ret = -1;
+		} else {
+			ret = i;
+		}
+	}
+	if (mq) {
+		mq_unref(mq);
+	}
+	return ret;
+}
+
+int mq_receive_batch(mqd_t _mq, struct mq_msgvec *vec, int count,
+		     const struct timespec *abstime)
+{
+	mqd_internal_t *mq = 0;
+	mq_msg_t *m = 0;
+	int edge = 0;
+	int ret = 0;
+	int i = 0;
+	unsigned timeout = 0;
+
+	if (!(mq = mq_ref_mux(_mq))) {
+		ret = -1;
+	}
+	if ((ret == 0) && (count < 0)) {
+		errno = EINVAL;
+		ret = -1;
+	}
+	for (i = 0; (ret == 0) && (i < count); i++) {
+		if (vec[i].msg_len < (size_t) mq->msgsize) {
+			errno = EMSGSIZE;
+			ret = -1;
+		}
+	}
+	if ((ret == 0) && (count > 0)) {
+		if ((ret = get_tick_timeout(mq->flags, abstime, &timeout)) != 0) {
+			errno = ret;
+			ret = -1;
+		}
+	}
+	if ((ret == 0) && (count > 0)) {
+		mut_lock(&mq->mux, WAIT);
+		for (i = 0; i < count; i++) {
+			// Return as soon as the queue runs dry.
+			m = msg_dequeue_wait_locked(mq, i ? 0 : timeout);
+			if (!m) {
+				break;
 			}
+			POSIX_MQUEUE_COPY(vec[i].msg_ptr, MSG_DATA(m), m->len);
+			vec[i].msg_len = m->len;
+			vec[i].msg_prio = m->prio;
+			msg_free_locked(mq, m);
+		}
+		mq_wake_n_locked(mq, &mq->wsend, i);
+		edge = mq_wm_take_locked(mq);
+		mut_unlock(&mq->mux);
+		if (edge) {
+			mq_wm_deliver(_mq, mq);
+		}
+		if (i == 0) {
+			mq_timeout_errno(mq);
+			ret = -1;
+		} else {
+			ret = i;
+		}
+	}
+	if (mq) {
+		mq_unref(mq);
+	}
+	return ret;
+}
+
+int mq_setwatermark(mqd_t _mq, const mq_watermark_t * wm)
+{
+	mqd_internal_t *mq = 0;
+	int ret = 0;
+
+	if (!(mq = mq_ref_mux(_mq))) {
+		return -1;
+	}
+	// The SPSC ring keeps no depth under a lock to compare against.
+	if ((mq->flags & MQ_SPSC) ||
+	    ((wm != 0) && (wm->high != 0) &&
+	     ((wm->high > mq->maxmsg) || (wm->low >= wm->high)))) {
+		errno = EINVAL;
+		ret = -1;
+	}
+	if (ret == 0) {
+		mut_lock(&mq->mux, WAIT);
+		if (!wm || (wm->high == 0)) {
+			memset(&mq->wm, 0, sizeof(mq->wm));
+		} else {
+			mq->wm = *wm;
+		}
+		mq->wm_high = (mq->wm.high != 0) && (mq->n >= mq->wm.high);
+		mq->wm_done = mq->wm_seq;
+		mut_unlock(&mq->mux);
+	}
+	mq_unref(mq);
+	return ret;
+}
+
+int mq_notify(mqd_t _mq, const struct sigevent *notification)
+{
+	mqd_internal_t *mq = 0;
+	int ret = 0;
+
+	if (!(mq = mq_ref_mux(_mq))) {
+		return -1;
+	}
+	if ((notification != 0) &&
+	    (notification->sigev_notify != SIGEV_NONE) &&
+	    (notification->sigev_notify != SIGEV_THREAD)) {
+		// SIGEV_SIGNAL is not supported.
+		errno = EINVAL;
+		ret = -1;
+	}
+	if (ret == 0) {
+		mut_lock(&mq->mux, WAIT);
+		if (!notification) {
+			mq->notify_on = 0;
+		} else if (mq->notify_on) {
+			errno = EBUSY;
 			ret = -1;
+		} else {
+			mq->notify = *notification;
+			mq->notify_on = 1;
 		}
+		mut_unlock(&mq->mux);
+	}
+	mq_unref(mq);
+	return ret;
+}
+
+/**
+ * @brief Ready events of a polled queue.
+ */
+static short mq_poll_events_locked(mqd_internal_t * mq, short events)
+{
+	short ready = 0;
+
+	if (mq->n != 0) {
+		ready |= MQ_POLLIN;
 	}
+	if ((mq->n + mq->loaned < mq->maxmsg) ||
+	    ((mq->flags & MQ_OVERWRITE) && (mq->n != 0))) {
+		ready |= MQ_POLLOUT;
+	}
+	return ready & events;
+}
 
+int mq_poll(struct mq_pollfd *fds, int nfds, const struct timespec *abstime)
+{
+	mqd_internal_t *mqs[POSIX_MQUEUE_POLL_MAX];
+	mq_poll_link_t links[POSIX_MQUEUE_POLL_MAX];
+	mq_poller_t p;
+	unsigned timeout = WAIT;
+	unsigned start, elapsed;
+	int ret = 0;
+	int i;
+
+	if ((nfds < 0) || (nfds > POSIX_MQUEUE_POLL_MAX)) {
+		errno = EINVAL;
+		return -1;
+	}
+	// A timeout in the past just checks the queues once.
+	if (abstime2ticks(abstime, &timeout) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	sem_init(&p.sem, 0);
+	for (i = 0; i < nfds; i++) {
+		fds[i].revents = 0;
+		if (!(mqs[i] = mq_ref_mux(fds[i].mqdes))) {
+			fds[i].revents = MQ_POLLNVAL;
+			continue;
+		}
+		// Watch the queue before the first check, so no change can
+		// slip in between.
+		lle_init(&links[i].ll);
+		links[i].poller = &p;
+		mut_lock(&mqs[i]->mux, WAIT);
+		ll_addt(&mqs[i]->wpoll, &links[i].ll);
+		mut_unlock(&mqs[i]->mux);
+	}
+	for (;;) {
+		__atomic_store_n(&p.woken, 0, __ATOMIC_RELEASE);
+		ret = 0;
+		for (i = 0; i < nfds; i++) {
+			if (mqs[i]) {
+				mut_lock(&mqs[i]->mux, WAIT);
+				fds[i].revents =
+				    mq_poll_events_locked(mqs[i], fds[i].events);
+				mut_unlock(&mqs[i]->mux);
+			}
+			if (fds[i].revents) {
+				ret++;
+			}
+		}
+		if ((ret != 0) || (timeout == 0)) {
+			break;
+		}
+		start = tmr_ticks;
+		if (sem_get(&p.sem, timeout) != 0) {
+			// Timed out; the next scan is the last one.
+			timeout = 0;
+		} else if (timeout != WAIT) {
+			elapsed = tmr_ticks - start;
+			timeout = (elapsed < timeout) ? timeout - elapsed : 0;
+		}
+	}
+	for (i = 0; i < nfds; i++) {
+		if (mqs[i]) {
+			mut_lock(&mqs[i]->mux, WAIT);
+			lle_del(&links[i].ll);
+			mut_unlock(&mqs[i]->mux);
+			mq_unref(mqs[i]);
+		}
+	}
 	return ret;
 }
 
@@ -452,6 +1972,7 @@ int mq_unlink(const char *name)
 	int ret = 0;
 	int removed = 0;
 	size_t size = 0;
+	unsigned hash = 0;
 
 	mq_check_init();
 	if (!validate_name(name, &size)) {
@@ -460,16 +1981,16 @@ int mq_unlink(const char *name)
 	}
 
 	if (ret == 0) {
+		hash = posix_name_hash(name, size);
 		mut_lock(&allq_mux, WAIT);
-		mq = mq_find_locked(name);
+		mq = mq_find_locked(name, size, hash);
 		if (mq != 0) {
-			// If the queue exists and there are no open descriptors to it,
-			// remove it from the list.
+			// The name goes away now, later opens create a new queue.
+			posix_name_del(&mq->name);
+			// If there are no open descriptors to the queue, remove it.
 			if (mq->open_count == 0) {
-				lle_del(&mq->ll);
-
 				// Set the flag to delete the queue. Deleting the queue is deferred
-				// until xQueueListMutex is released.
+				// until allq_mux is released.
 				removed = 1;
 			} else {
 				// If the queue has open descriptors, set the pending unlink flag
@@ -484,7 +2005,7 @@ int mq_unlink(const char *name)
 	}
 	// Delete all resources used by the queue if needed. */
 	if (removed) {
-		mq_free(mq);
+		mq_retire(mq);
 	}
 
 	return ret;
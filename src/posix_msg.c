@@ -0,0 +1,258 @@
+/**
+ * Copyright (C) 2018 socware.net.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://socware.net
+ */
+#include <string.h>
+
+#include <errno.h>
+#include <hcos_msg.h>
+#include <hcos/task.h>
+#include "utils.h"
+
+/**
+ * @brief A client blocked in msg_send. Lives on the client's stack.
+ *
+ * Once a server takes it off clients, the request can no longer time out
+ * and the client waits on done until msg_reply or msg_error.
+ */
+typedef struct msg_client {
+	lle_t ll;
+	const void *req;
+	size_t req_len;
+	void *rep;
+	size_t rep_len;
+	ssize_t ret;		///< Reply length, or -1.
+	int err;		///< errno of msg_send when ret is -1.
+	int pri;		///< Client priority.
+	int taken;		///< Set once a server received the request.
+	task_t *srv;		///< Server holding the request.
+	int srv_pri;		///< Server priority before it was raised.
+	sem_t done;
+} msg_client_t;
+
+/**
+ * @brief A server blocked in msg_receive. Lives on the server's stack.
+ */
+typedef struct msg_server {
+	lle_t ll;
+	void *buf;
+	size_t len;
+	task_t *task;
+	msg_client_t *c;	///< Client handed over by msg_send.
+	sem_t sem;
+} msg_server_t;
+
+static size_t msg_min(size_t a, size_t b)
+{
+	return (a < b) ? a : b;
+}
+
+/**
+ * @brief Hand a request to the server task srv, raising srv to the client's
+ * priority. Lower priority numbers are more urgent.
+ */
+static void msg_take(msg_client_t * c, task_t * srv)
+{
+	c->taken = 1;
+	c->srv = srv;
+	c->srv_pri = srv->pri;
+	if (c->pri < srv->pri) {
+		task_pri(srv, c->pri);
+	}
+}
+
+/**
+ * @brief Restore the server priority and release the client.
+ */
+static void msg_done(msg_client_t * c)
+{
+	if (c->pri < c->srv_pri) {
+		task_pri(c->srv, c->srv_pri);
+	}
+	// The client may return as soon as it is posted.
+	sem_post(&c->done);
+}
+
+/**
+ * @brief Queue a client behind all clients of the same or higher priority.
+ */
+static void msg_client_add_locked(msg_chan_t * ch, msg_client_t * c)
+{
+	lle_t *p;
+
+	ll_for_each(&ch->clients, p) {
+		if (lle_get(p, msg_client_t, ll)->pri > c->pri) {
+			break;
+		}
+	}
+	lle_add_before(p, &c->ll);
+}
+
+int msg_chan_init(msg_chan_t * ch)
+{
+	mut_init(&ch->mux);
+	ll_init(&ch->clients);
+	ll_init(&ch->servers);
+	return 0;
+}
+
+int msg_chan_destroy(msg_chan_t * ch)
+{
+	int ret = 0;
+
+	mut_lock(&ch->mux, WAIT);
+	if (!ll_empty(&ch->clients) || !ll_empty(&ch->servers)) {
+		errno = EBUSY;
+		ret = -1;
+	}
+	mut_unlock(&ch->mux);
+	return ret;
+}
+
+ssize_t msg_send(msg_chan_t * ch, const void *req, size_t req_len,
+		 void *rep, size_t rep_len, const struct timespec *abstime)
+{
+	msg_client_t c;
+	msg_server_t *s = 0;
+	unsigned timeout = 0;
+	lle_t *p;
+
+	if (abstime2ticks(abstime, &timeout) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	c.req = req;
+	c.req_len = req_len;
+	c.rep = rep;
+	c.rep_len = rep_len;
+	c.ret = -1;
+	c.err = ETIMEDOUT;
+	c.pri = _task_cur->pri;
+	c.taken = 0;
+	sem_init(&c.done, 0);
+	lle_init(&c.ll);
+
+	mut_lock(&ch->mux, WAIT);
+	if ((p = ll_head(&ch->servers)) != 0) {
+		// A server is already waiting, hand the request straight over.
+		s = lle_get(p, msg_server_t, ll);
+		lle_del(p);
+		s->c = &c;
+		msg_take(&c, s->task);
+	} else if (timeout != 0) {
+		msg_client_add_locked(ch, &c);
+	}
+	mut_unlock(&ch->mux);
+
+	if (s) {
+		memcpy(s->buf, req, msg_min(req_len, s->len));
+		sem_post(&s->sem);
+		sem_get(&c.done, WAIT);
+	} else if ((timeout != 0) && (sem_get(&c.done, timeout) != 0)) {
+		mut_lock(&ch->mux, WAIT);
+		if (!c.taken) {
+			lle_del(&c.ll);
+		}
+		mut_unlock(&ch->mux);
+		// Too late to give up, a server holds the request.
+		if (c.taken) {
+			sem_get(&c.done, WAIT);
+		}
+	}
+	if (c.ret < 0) {
+		errno = c.err;
+	}
+	return c.ret;
+}
+
+ssize_t msg_receive(msg_chan_t * ch, void *buf, size_t len,
+		    msg_rcvid_t * rcvid, const struct timespec *abstime)
+{
+	msg_server_t s;
+	msg_client_t *c = 0;
+	ssize_t ret = 0;
+	unsigned timeout = 0;
+	lle_t *p;
+
+	if (abstime2ticks(abstime, &timeout) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	s.buf = buf;
+	s.len = len;
+	s.task = _task_cur;
+	s.c = 0;
+	sem_init(&s.sem, 0);
+	lle_init(&s.ll);
+
+	mut_lock(&ch->mux, WAIT);
+	if ((p = ll_head(&ch->clients)) != 0) {
+		c = lle_get(p, msg_client_t, ll);
+		lle_del(p);
+		msg_take(c, _task_cur);
+	} else if (timeout != 0) {
+		ll_addt(&ch->servers, &s.ll);
+	}
+	mut_unlock(&ch->mux);
+
+	if (c) {
+		// The client stays blocked until the reply, so its buffer
+		// can be read without the lock.
+		memcpy(buf, c->req, msg_min(len, c->req_len));
+	} else if (timeout != 0) {
+		if (sem_get(&s.sem, timeout) != 0) {
+			mut_lock(&ch->mux, WAIT);
+			if (!s.c) {
+				lle_del(&s.ll);
+			}
+			mut_unlock(&ch->mux);
+			// A client took us and is copying its request.
+			if (s.c) {
+				sem_get(&s.sem, WAIT);
+			}
+		}
+		c = s.c;
+	}
+	if (c) {
+		*rcvid = c;
+		ret = (ssize_t) c->req_len;
+	} else {
+		errno = ETIMEDOUT;
+		ret = -1;
+	}
+	return ret;
+}
+
+int msg_reply(msg_rcvid_t rcvid, const void *rep, size_t rep_len)
+{
+	memcpy(rcvid->rep, rep, msg_min(rep_len, rcvid->rep_len));
+	rcvid->ret = (ssize_t) rep_len;
+	msg_done(rcvid);
+	return 0;
+}
+
+int msg_error(msg_rcvid_t rcvid, int err)
+{
+	rcvid->ret = -1;
+	rcvid->err = err;
+	msg_done(rcvid);
+	return 0;
+}
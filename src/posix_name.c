@@ -0,0 +1,100 @@
+/**
+ * Copyright (C) 2018 socware.net.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://socware.net
+ */
+#include <string.h>
+#include <errno.h>
+#include "posix_name.h"
+
+#define BUCKET(_hash)  ((_hash) & (POSIX_NAME_HASH_SZ - 1))
+
+#if (POSIX_NAME_HASH_SZ & (POSIX_NAME_HASH_SZ - 1)) != 0
+#error "POSIX_NAME_HASH_SZ must be a power of 2"
+#endif
+
+void posix_names_init(posix_names_t * r)
+{
+	int i;
+	for (i = 0; i < POSIX_NAME_HASH_SZ; i++) {
+		ll_init(&r->bucket[i]);
+	}
+}
+
+unsigned posix_name_hash(const char *name, size_t len)
+{
+	// 32-bit FNV-1a
+	unsigned h = 2166136261u;
+	while (len--) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+posix_name_t *posix_name_find(posix_names_t * r,
+			      const char *name, size_t len, unsigned hash)
+{
+	lle_t *p;
+	ll_for_each(&r->bucket[BUCKET(hash)], p) {
+		posix_name_t *n = lle_get(p, posix_name_t, ll);
+		if ((n->hash == hash) && (n->len == len)
+		    && (memcmp(n->str, name, len) == 0)) {
+			return n;
+		}
+	}
+	return 0;
+}
+
+int posix_name_add(posix_names_t * r, posix_name_t * n,
+		   const char *name, size_t len, unsigned hash)
+{
+	char *str = hcos_posix_alloc(POSIX_NAME, len + 1);
+	if (!str) {
+		return ENOMEM;
+	}
+	memcpy(str, name, len);
+	str[len] = 0;
+	posix_name_ref(r, n, str, len, hash);
+	return 0;
+}
+
+void posix_name_ref(posix_names_t * r, posix_name_t * n,
+		    const char *name, size_t len, unsigned hash)
+{
+	n->str = name;
+	n->len = len;
+	n->hash = hash;
+	lle_init(&n->ll);
+	ll_addt(&r->bucket[BUCKET(hash)], &n->ll);
+}
+
+void posix_name_del(posix_name_t * n)
+{
+	lle_del(&n->ll);
+}
+
+void posix_name_free(posix_name_t * n)
+{
+	if (n->str) {
+		hcos_posix_free(POSIX_NAME, (void *)n->str);
+		n->str = 0;
+	}
+}
@@ -0,0 +1,85 @@
+/**
+ * Copyright (C) 2018 socware.net.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://socware.net
+ */
+
+/**
+ * @file posix_name.h
+ * @brief Hashed registry of named objects.
+ *
+ * Objects embed a posix_name_t and are found by name in O(1) on average.
+ * The registry keeps one exactly sized copy of each name, so names up to
+ * POSIX_NAME_MAX cost no more memory than their length. Callers serialize
+ * access to a registry with their own lock.
+ */
+
+#ifndef _HCOS_POSIX_NAME_
+#define _HCOS_POSIX_NAME_
+
+#include <stddef.h>
+#include "hcos_types.h"
+
+typedef struct posix_names {
+	ll_t bucket[POSIX_NAME_HASH_SZ];
+} posix_names_t;
+
+void posix_names_init(posix_names_t * r);
+
+/**
+ * @brief Hash a name of len bytes. Done before taking the registry lock.
+ */
+unsigned posix_name_hash(const char *name, size_t len);
+
+/**
+ * @return The entry registered under name, or 0.
+ */
+posix_name_t *posix_name_find(posix_names_t * r,
+			      const char *name, size_t len, unsigned hash);
+
+/**
+ * @brief Register n under a copy of name.
+ *
+ * @return 0 on success; ENOMEM if the copy cannot be allocated.
+ */
+int posix_name_add(posix_names_t * r, posix_name_t * n,
+		   const char *name, size_t len, unsigned hash);
+
+/**
+ * @brief Register n under name itself, without copying it.
+ *
+ * name must stay valid until n is removed, and posix_name_free must not be
+ * called on n.
+ */
+void posix_name_ref(posix_names_t * r, posix_name_t * n,
+		    const char *name, size_t len, unsigned hash);
+
+/**
+ * @brief Remove n from its registry. The name stays readable until
+ * posix_name_free.
+ */
+void posix_name_del(posix_name_t * n);
+
+/**
+ * @brief Release the copy of the name made by posix_name_add.
+ */
+void posix_name_free(posix_name_t * n);
+
+#endif
@@ -0,0 +1,280 @@
+/**
+ * Copyright (C) 2018 socware.net.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://socware.net
+ */
+#include <string.h>
+
+#include <errno.h>
+#include <hcos_pipe.h>
+#include "utils.h"
+
+/**
+ * @brief A thread blocked on a pipe, linked on wread or wwrite.
+ *
+ * Lives on the waiting thread's stack. need is the number of bytes, or
+ * bytes of room, that make it worth waking.
+ */
+typedef struct pipe_waiter {
+	lle_t ll;
+	sem_t sem;
+	unsigned need;
+	int woken;
+} pipe_waiter_t;
+
+static size_t pipe_min(size_t a, size_t b)
+{
+	return (a < b) ? a : b;
+}
+
+/**
+ * @brief Sleep on a wait list until woken or the timeout expires.
+ *
+ * Called and returns with pipe->mux held; timeout is updated with the
+ * ticks left.
+ *
+ * @return 0 if woken; -1 on timeout.
+ */
+static int pipe_wait_locked(pipe_t * pipe, ll_t * wl, unsigned need,
+			    unsigned *timeout)
+{
+	pipe_waiter_t w;
+	unsigned start = tmr_ticks;
+	unsigned elapsed;
+
+	if (*timeout == 0) {
+		return -1;
+	}
+	sem_init(&w.sem, 0);
+	w.need = need;
+	w.woken = 0;
+	lle_init(&w.ll);
+	ll_addt(wl, &w.ll);
+	mut_unlock(&pipe->mux);
+	sem_get(&w.sem, *timeout);
+	mut_lock(&pipe->mux, WAIT);
+	if (!w.woken) {
+		lle_del(&w.ll);
+		*timeout = 0;
+		return -1;
+	}
+	if (*timeout != WAIT) {
+		elapsed = tmr_ticks - start;
+		*timeout = (elapsed < *timeout) ? *timeout - elapsed : 0;
+	}
+	return 0;
+}
+
+/**
+ * @brief Wake the first waiter on a wait list if avail bytes satisfy it.
+ */
+static void pipe_wake_locked(ll_t * wl, unsigned avail)
+{
+	lle_t *p = ll_head(wl);
+	pipe_waiter_t *w;
+
+	if (p && ((w = lle_get(p, pipe_waiter_t, ll))->need <= avail)) {
+		lle_del(p);
+		w->woken = 1;
+		sem_post(&w->sem);
+	}
+}
+
+/**
+ * @brief Move len buffered bytes out of the ring into iov.
+ */
+static void pipe_get_locked(pipe_t * pipe, const struct iovec *iov,
+			    size_t len)
+{
+	size_t off = 0, n;
+
+	while (len) {
+		n = pipe_min(pipe_min(len, iov->iov_len - off),
+			     pipe->size - pipe->rd);
+		memcpy((char *)iov->iov_base + off, pipe->buf + pipe->rd, n);
+		if ((pipe->rd += n) == pipe->size) {
+			pipe->rd = 0;
+		}
+		if ((off += n) == iov->iov_len) {
+			iov++;
+			off = 0;
+		}
+		pipe->n -= n;
+		len -= n;
+	}
+}
+
+/**
+ * @brief Append len bytes from iov to the ring, which has room for them.
+ */
+static void pipe_put_locked(pipe_t * pipe, const struct iovec *iov,
+			    size_t len)
+{
+	size_t off = 0, n, wr;
+
+	while (len) {
+		wr = pipe->rd + pipe->n;
+		if (wr >= pipe->size) {
+			wr -= pipe->size;
+		}
+		n = pipe_min(pipe_min(len, iov->iov_len - off),
+			     pipe->size - wr);
+		memcpy(pipe->buf + wr, (const char *)iov->iov_base + off, n);
+		if ((off += n) == iov->iov_len) {
+			iov++;
+			off = 0;
+		}
+		pipe->n += n;
+		len -= n;
+	}
+}
+
+/**
+ * @brief Common part of the read and write calls.
+ *
+ * Waits until the threshold of the direction is met, or until abstime,
+ * then transfers as much as the ring allows. Each side wakes the other
+ * once its threshold is crossed, and the next waiter of its own side if
+ * something is left for it.
+ */
+static ssize_t pipe_xfer(pipe_t * pipe, const struct iovec *iov, int iovcnt,
+			 const struct timespec *abstime, int write)
+{
+	ll_t *wl = write ? &pipe->wwrite : &pipe->wread;
+	unsigned timeout = 0;
+	size_t total = 0, need, avail, len;
+	int i;
+
+	if (iovcnt < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (i = 0; i < iovcnt; i++) {
+		total += iov[i].iov_len;
+	}
+	if (abstime2ticks(abstime, &timeout) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (total == 0) {
+		return 0;
+	}
+	mut_lock(&pipe->mux, WAIT);
+	need = pipe_min(total, write ? pipe->wr_low : pipe->rd_low);
+	for (;;) {
+		avail = write ? pipe->size - pipe->n : pipe->n;
+		if ((avail >= need) ||
+		    (pipe_wait_locked(pipe, wl, need, &timeout) != 0)) {
+			break;
+		}
+	}
+	avail = write ? pipe->size - pipe->n : pipe->n;
+	if ((len = pipe_min(total, avail)) != 0) {
+		if (write) {
+			pipe_put_locked(pipe, iov, len);
+		} else {
+			pipe_get_locked(pipe, iov, len);
+		}
+		pipe_wake_locked(&pipe->wread, pipe->n);
+		pipe_wake_locked(&pipe->wwrite, pipe->size - pipe->n);
+	}
+	mut_unlock(&pipe->mux);
+	if (len == 0) {
+		errno = ETIMEDOUT;
+		return -1;
+	}
+	return (ssize_t) len;
+}
+
+int pipe_init(pipe_t * pipe, size_t size)
+{
+	if ((size == 0) || (size > 0x7fffffff)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (!(pipe->buf = hcos_posix_alloc(POSIX_PIPE, size))) {
+		errno = ENOMEM;
+		return -1;
+	}
+	mut_init(&pipe->mux);
+	ll_init(&pipe->wread);
+	ll_init(&pipe->wwrite);
+	pipe->size = size;
+	pipe->rd = pipe->n = 0;
+	pipe->rd_low = pipe->wr_low = 1;
+	return 0;
+}
+
+int pipe_destroy(pipe_t * pipe)
+{
+	int ret = 0;
+
+	mut_lock(&pipe->mux, WAIT);
+	if (!ll_empty(&pipe->wread) || !ll_empty(&pipe->wwrite)) {
+		errno = EBUSY;
+		ret = -1;
+	}
+	mut_unlock(&pipe->mux);
+	if (ret == 0) {
+		hcos_posix_free(POSIX_PIPE, pipe->buf);
+		pipe->buf = 0;
+	}
+	return ret;
+}
+
+int pipe_setthreshold(pipe_t * pipe, size_t rd_low, size_t wr_low)
+{
+	if ((rd_low == 0) || (wr_low == 0) || (rd_low > pipe->size) ||
+	    (wr_low > pipe->size)) {
+		errno = EINVAL;
+		return -1;
+	}
+	mut_lock(&pipe->mux, WAIT);
+	pipe->rd_low = rd_low;
+	pipe->wr_low = wr_low;
+	mut_unlock(&pipe->mux);
+	return 0;
+}
+
+ssize_t pipe_read(pipe_t * pipe, void *buf, size_t len,
+		  const struct timespec *abstime)
+{
+	struct iovec iov = {.iov_base = buf,.iov_len = len };
+	return pipe_xfer(pipe, &iov, 1, abstime, 0);
+}
+
+ssize_t pipe_write(pipe_t * pipe, const void *buf, size_t len,
+		   const struct timespec *abstime)
+{
+	struct iovec iov = {.iov_base = (void *)buf,.iov_len = len };
+	return pipe_xfer(pipe, &iov, 1, abstime, 1);
+}
+
+ssize_t pipe_readv(pipe_t * pipe, const struct iovec *iov, int iovcnt,
+		   const struct timespec *abstime)
+{
+	return pipe_xfer(pipe, iov, iovcnt, abstime, 0);
+}
+
+ssize_t pipe_writev(pipe_t * pipe, const struct iovec *iov, int iovcnt,
+		    const struct timespec *abstime)
+{
+	return pipe_xfer(pipe, iov, iovcnt, abstime, 1);
+}
@@ -0,0 +1,474 @@
+/**
+ * Copyright (C) 2018 socware.net.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://socware.net
+ */
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <hcos_pool.h>
+#include "utils.h"
+
+/**
+ * @brief A posix_pool_wait caller, linked on widle.
+ *
+ * Lives on the caller's stack; the waker unlinks it and sets woken under
+ * the pool mutex.
+ */
+typedef struct pool_waiter {
+	lle_t ll;
+	sem_t sem;
+	int woken;
+} pool_waiter_t;
+
+/**
+ * @brief Range left in a posix_pool_parallel_for deque.
+ *
+ * The owner takes chunks off lo, thieves take the upper half off hi.
+ */
+typedef struct pool_deque {
+	mut_t mux;
+	long lo;
+	long hi;
+} pool_deque_t;
+
+/**
+ * @brief Shared state of a posix_pool_parallel_for call, followed by one
+ * deque per thread.
+ *
+ * Referenced by the caller and by each helper job it queued, since a
+ * helper may only get to run after the caller has returned.
+ */
+typedef struct pool_for {
+	posix_pool_t *pool;
+	void (*fn) (long lo, long hi, void *arg);
+	void *arg;
+	long grain;
+	long left;		///< Iterations not yet run, updated atomically.
+	unsigned ref;		///< Updated atomically.
+	unsigned next;		///< Last deque taken by a helper, updated atomically.
+	unsigned nq;		///< Deques, the caller owning the first.
+	sem_t done;		///< Posted when left drops to 0.
+	pool_deque_t q[];
+} pool_for_t;
+
+/**
+ * @brief Drop a reference, keeping the last released state for the next call.
+ */
+static void pool_for_put(pool_for_t * pf)
+{
+	posix_pool_t *pool = pf->pool;
+	pool_for_t *none = 0;
+
+	if (__atomic_sub_fetch(&pf->ref, 1, __ATOMIC_ACQ_REL) != 0) {
+		return;
+	}
+	if (!__atomic_compare_exchange_n(&pool->for_spare, &none, pf, 0,
+					 __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+		hcos_posix_free(POSIX_POOL, pf);
+	}
+}
+
+/**
+ * @brief Take the next chunk off the front of a deque.
+ *
+ * @return 1 with [*lo, *hi) set; 0 if the deque is empty.
+ */
+static int pool_for_pop(pool_for_t * pf, pool_deque_t * q, long *lo,
+			long *hi)
+{
+	int ret = 0;
+
+	mut_lock(&q->mux, WAIT);
+	if (q->lo < q->hi) {
+		*lo = q->lo;
+		*hi = (q->hi - q->lo > pf->grain) ? q->lo + pf->grain : q->hi;
+		q->lo = *hi;
+		ret = 1;
+	}
+	mut_unlock(&q->mux);
+	return ret;
+}
+
+/**
+ * @brief Refill the empty deque of thread self from the back of another.
+ *
+ * Victims are tried in order after self, and half of what a victim has
+ * left is taken, in whole chunks.
+ *
+ * @return 1 if something was stolen; 0 if every deque is empty.
+ */
+static int pool_for_steal(pool_for_t * pf, unsigned self)
+{
+	pool_deque_t *v;
+	long n, lo = 0, hi = 0;
+	unsigned i;
+
+	for (i = 1; i < pf->nq; i++) {
+		v = &pf->q[(self + i) % pf->nq];
+		mut_lock(&v->mux, WAIT);
+		if ((n = v->hi - v->lo) > pf->grain) {
+			n = (n / 2 + pf->grain - 1) / pf->grain * pf->grain;
+		}
+		if (n > 0) {
+			hi = v->hi;
+			lo = v->hi = hi - n;
+		}
+		mut_unlock(&v->mux);
+		if (n > 0) {
+			mut_lock(&pf->q[self].mux, WAIT);
+			pf->q[self].lo = lo;
+			pf->q[self].hi = hi;
+			mut_unlock(&pf->q[self].mux);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Run chunks as thread self until no deque has any left.
+ */
+static void pool_for_run(pool_for_t * pf, unsigned self)
+{
+	long lo, hi;
+
+	do {
+		while (pool_for_pop(pf, &pf->q[self], &lo, &hi)) {
+			pf->fn(lo, hi, pf->arg);
+			if (__atomic_sub_fetch(&pf->left, hi - lo,
+					       __ATOMIC_ACQ_REL) == 0) {
+				sem_post(&pf->done);
+			}
+		}
+	} while (pool_for_steal(pf, self));
+}
+
+static void pool_for_helper(void *arg)
+{
+	pool_for_t *pf = (pool_for_t *) arg;
+
+	pool_for_run(pf, __atomic_add_fetch(&pf->next, 1, __ATOMIC_RELAXED));
+	pool_for_put(pf);
+}
+
+/**
+ * @brief Account for a finished or discarded job, waking waiters when the
+ * pool goes idle.
+ */
+static void pool_done_locked(posix_pool_t * pool, unsigned n)
+{
+	lle_t *p;
+
+	pool->pending -= n;
+	if (pool->pending != 0) {
+		return;
+	}
+	while ((p = ll_head(&pool->widle)) != 0) {
+		pool_waiter_t *w = lle_get(p, pool_waiter_t, ll);
+		lle_del(p);
+		w->woken = 1;
+		sem_post(&w->sem);
+	}
+}
+
+static void *pool_worker(void *arg)
+{
+	posix_pool_t *pool = (posix_pool_t *) arg;
+	posix_pool_job_t job;
+
+	for (;;) {
+		// One count per queued job, and one per worker at shutdown.
+		sem_get(&pool->jobs, WAIT);
+		mut_lock(&pool->mux, WAIT);
+		if (pool->n == 0) {
+			mut_unlock(&pool->mux);
+			if (pool->stop) {
+				break;
+			}
+			continue;
+		}
+		job = pool->ring[pool->rd];
+		if (++pool->rd == pool->depth) {
+			pool->rd = 0;
+		}
+		pool->n--;
+		mut_unlock(&pool->mux);
+		sem_post(&pool->room);
+
+		job.fn(job.arg);
+
+		mut_lock(&pool->mux, WAIT);
+		pool_done_locked(pool, 1);
+		mut_unlock(&pool->mux);
+	}
+	return 0;
+}
+
+/**
+ * @brief Wake and join the first n workers.
+ */
+static void pool_join(posix_pool_t * pool, unsigned n)
+{
+	unsigned i;
+
+	mut_lock(&pool->mux, WAIT);
+	pool->stop = 1;
+	mut_unlock(&pool->mux);
+	sem_post_n(&pool->jobs, n);
+	for (i = 0; i < n; i++) {
+		pthread_join(pool->workers[i], 0);
+	}
+}
+
+/**
+ * @brief Drop the queued jobs.
+ *
+ * Queued parallel_for helpers still release their reference; the call
+ * that queued them finishes without them.
+ */
+static void pool_discard_locked(posix_pool_t * pool)
+{
+	posix_pool_job_t *job;
+
+	while (pool->n != 0) {
+		job = &pool->ring[pool->rd];
+		if (job->fn == pool_for_helper) {
+			pool_for_put((pool_for_t *) job->arg);
+		}
+		if (++pool->rd == pool->depth) {
+			pool->rd = 0;
+		}
+		pool->n--;
+		pool_done_locked(pool, 1);
+	}
+}
+
+int posix_pool_init(posix_pool_t * pool, unsigned nworkers, unsigned depth,
+		    size_t stacksize, int priority)
+{
+	struct sched_param param = {.sched_priority = priority };
+	pthread_attr_t attr;
+	unsigned i;
+
+	pthread_attr_init(&attr);
+	if ((nworkers == 0) || (nworkers > 0xffff) || (depth == 0) ||
+	    (depth > 0xffff) ||
+	    (pthread_attr_setschedparam(&attr, &param) != 0) ||
+	    ((stacksize != 0) &&
+	     (pthread_attr_setstacksize(&attr, stacksize) != 0))) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (!(pool->ring = hcos_posix_alloc(POSIX_POOL,
+					    depth * sizeof(posix_pool_job_t) +
+					    nworkers * sizeof(pthread_t)))) {
+		errno = EAGAIN;
+		return -1;
+	}
+	pool->workers = (pthread_t *) (pool->ring + depth);
+	mut_init(&pool->mux);
+	sem_init(&pool->jobs, 0);
+	sem_init(&pool->room, depth);
+	ll_init(&pool->widle);
+	pool->depth = depth;
+	pool->rd = pool->n = 0;
+	pool->nworkers = nworkers;
+	pool->pending = 0;
+	pool->stop = 0;
+	pool->for_spare = 0;
+	for (i = 0; i < nworkers; i++) {
+		if (pthread_create(&pool->workers[i], &attr, pool_worker,
+				   pool) != 0) {
+			pool_join(pool, i);
+			hcos_posix_free(POSIX_POOL, pool->ring);
+			errno = EAGAIN;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int posix_pool_destroy(posix_pool_t * pool, int drain)
+{
+	mut_lock(&pool->mux, WAIT);
+	if (pool->stop) {
+		mut_unlock(&pool->mux);
+		errno = EINVAL;
+		return -1;
+	}
+	if (!drain) {
+		pool_discard_locked(pool);
+	}
+	mut_unlock(&pool->mux);
+	pool_join(pool, pool->nworkers);
+	if (pool->for_spare) {
+		hcos_posix_free(POSIX_POOL, pool->for_spare);
+	}
+	hcos_posix_free(POSIX_POOL, pool->ring);
+	pool->ring = 0;
+	return 0;
+}
+
+/**
+ * @brief Queue a job once a ring slot is free, waiting up to timeout ticks.
+ */
+static int pool_submit(posix_pool_t * pool, void (*fn) (void *), void *arg,
+		       unsigned timeout)
+{
+	unsigned wr;
+
+	if (sem_get(&pool->room, timeout) != 0) {
+		return (timeout == 0) ? EAGAIN : ETIMEDOUT;
+	}
+	mut_lock(&pool->mux, WAIT);
+	if (pool->stop) {
+		mut_unlock(&pool->mux);
+		sem_post(&pool->room);
+		return EINVAL;
+	}
+	wr = pool->rd + pool->n;
+	if (wr >= pool->depth) {
+		wr -= pool->depth;
+	}
+	pool->ring[wr].fn = fn;
+	pool->ring[wr].arg = arg;
+	pool->n++;
+	pool->pending++;
+	mut_unlock(&pool->mux);
+	sem_post(&pool->jobs);
+	return 0;
+}
+
+int posix_pool_submit(posix_pool_t * pool, void (*fn) (void *), void *arg,
+		      const struct timespec *abstime)
+{
+	unsigned timeout;
+	int ret;
+
+	if (abstime2ticks(abstime, &timeout) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ((ret = pool_submit(pool, fn, arg, timeout)) != 0) {
+		// A timeout in the past is a timeout, not a full queue.
+		errno = (ret == EAGAIN) ? ETIMEDOUT : ret;
+		return -1;
+	}
+	return 0;
+}
+
+int posix_pool_trysubmit(posix_pool_t * pool, void (*fn) (void *), void *arg)
+{
+	int ret;
+
+	if ((ret = pool_submit(pool, fn, arg, 0)) != 0) {
+		errno = ret;
+		return -1;
+	}
+	return 0;
+}
+
+int posix_pool_wait(posix_pool_t * pool, const struct timespec *abstime)
+{
+	pool_waiter_t w;
+	unsigned timeout;
+	int ret = 0;
+
+	if (abstime2ticks(abstime, &timeout) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	mut_lock(&pool->mux, WAIT);
+	if (pool->pending != 0) {
+		sem_init(&w.sem, 0);
+		w.woken = 0;
+		lle_init(&w.ll);
+		ll_addt(&pool->widle, &w.ll);
+		mut_unlock(&pool->mux);
+		sem_get(&w.sem, timeout);
+		mut_lock(&pool->mux, WAIT);
+		if (!w.woken) {
+			lle_del(&w.ll);
+			errno = ETIMEDOUT;
+			ret = -1;
+		}
+	}
+	mut_unlock(&pool->mux);
+	return ret;
+}
+
+int posix_pool_parallel_for(posix_pool_t * pool, long begin, long end,
+			    long grain, void (*fn) (long lo, long hi,
+						    void *arg), void *arg)
+{
+	unsigned nq = pool->nworkers + 1;
+	long chunks, lo, hi;
+	pool_for_t *pf;
+	unsigned i, helpers;
+
+	if (grain < 1) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (end <= begin) {
+		return 0;
+	}
+	if (!(pf = __atomic_exchange_n(&pool->for_spare, 0, __ATOMIC_ACQUIRE))
+	    && !(pf = hcos_posix_alloc(POSIX_POOL, sizeof(pool_for_t) +
+				       nq * sizeof(pool_deque_t)))) {
+		errno = ENOMEM;
+		return -1;
+	}
+	pf->pool = pool;
+	pf->fn = fn;
+	pf->arg = arg;
+	pf->grain = grain;
+	pf->left = end - begin;
+	pf->next = 0;
+	pf->nq = nq;
+	sem_init(&pf->done, 0);
+	// Whole chunks per deque, the first ones taking one more each.
+	chunks = (end - begin - 1) / grain + 1;
+	for (i = 0, lo = begin; i < nq; i++, lo = hi) {
+		hi = lo + (chunks / nq + (i < chunks % nq)) * grain;
+		if (hi > end) {
+			hi = end;
+		}
+		mut_init(&pf->q[i].mux);
+		pf->q[i].lo = lo;
+		pf->q[i].hi = hi;
+	}
+	// No helper for a range of a single chunk.
+	helpers = (chunks < nq) ? chunks - 1 : nq - 1;
+	pf->ref = 1 + helpers;
+	for (i = 0; i < helpers; i++) {
+		if (posix_pool_trysubmit(pool, pool_for_helper, pf) != 0) {
+			__atomic_sub_fetch(&pf->ref, helpers - i, __ATOMIC_ACQ_REL);
+			break;
+		}
+	}
+	pool_for_run(pf, 0);
+	if (__atomic_load_n(&pf->left, __ATOMIC_ACQUIRE) != 0) {
+		sem_get(&pf->done, WAIT);
+	}
+	pool_for_put(pf);
+	return 0;
+}
@@ -67,26 +67,276 @@ static const pthread_attr_t PTHTREAD_ATTR_DEFAULT = {
 	    (PTHREAD_CREATE_JOINABLE << SHFT_DETACH),
 };
 
+/**
+ * @brief Idle thread objects with their stacks, per stack size class, and
+ * the lists of live and ended threads.
+ *
+ * An ended thread may still be running on its stack, so it waits on the
+ * zombie list until the kernel reports its task dead and a later
+ * pthread_create or thread exit reclaims it.
+ */
+static struct {
+	mut_t mux;
+	ll_t idle[POSIX_THREAD_CACHE_CLASSES];
+	unsigned short n[POSIX_THREAD_CACHE_CLASSES];
+	ll_t live;		///< Threads from pthread_create until they end.
+	unsigned nlive;
+	ll_t zombie;		///< Ended threads not yet reclaimed.
+	int inited;
+} cache;
+
+/**
+ * @brief Thread specific data keys, guarded by cache.mux.
+ */
+static struct {
+	void (*destructor) (void *);
+	int used;
+} keys[POSIX_THREAD_KEYS_MAX];
+
+static void cache_check_init(void)
+{
+	int c;
+
+	if (cache.inited)
+		return;
+	mut_init(&cache.mux);
+	for (c = 0; c < POSIX_THREAD_CACHE_CLASSES; c++) {
+		ll_init(&cache.idle[c]);
+	}
+	ll_init(&cache.live);
+	ll_init(&cache.zombie);
+	cache.inited = 1;
+}
+
+/**
+ * @brief Cache class of a stack of stack_sz bytes.
+ *
+ * @return The class, or -1 if such stacks are not cached.
+ */
+static int stack_class(size_t stack_sz)
+{
+	int c;
+
+	if (POSIX_THREAD_CACHE_MAX == 0) {
+		return -1;
+	}
+	for (c = 0; c < POSIX_THREAD_CACHE_CLASSES; c++) {
+		if (stack_sz <= ((size_t)PTHREAD_STACK_MIN << c)) {
+			return c;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Allocate a thread object and its stack from the allocator.
+ */
+static pthread_internal_t *thread_new(size_t stack_sz)
+{
+	pthread_internal_t *thread;
+
+	thread = (pthread_internal_t *) hcos_posix_alloc(POSIX_THREAD,
+							 sizeof
+							 (pthread_internal_t));
+	if (!thread) {
+		return 0;
+	}
+	if (!(thread->stack = hcos_posix_alloc(POSIX_STACK, stack_sz))) {
+		hcos_posix_free(POSIX_THREAD, thread);
+		return 0;
+	}
+	thread->stack_cap = stack_sz;
+	lle_init(&thread->ll);
+	return thread;
+}
+
+/**
+ * @brief Get a cleared thread object with a stack of at least stack_sz bytes.
+ *
+ * Reuses the first idle thread of the class whose stack is big enough, and
+ * otherwise allocates a stack of exactly stack_sz bytes.
+ */
+static pthread_internal_t *thread_alloc(size_t stack_sz)
+{
+	pthread_internal_t *thread = 0, *t;
+	int c = stack_class(stack_sz);
+	size_t stack_cap;
+	unsigned *stack;
+	lle_t *p;
+
+	cache_check_init();
+	if (c >= 0) {
+		mut_lock(&cache.mux, WAIT);
+		ll_for_each(&cache.idle[c], p) {
+			t = lle_get(p, pthread_internal_t, ll);
+			if (t->stack_cap >= stack_sz) {
+				lle_del(p);
+				cache.n[c]--;
+				thread = t;
+				break;
+			}
+		}
+		mut_unlock(&cache.mux);
+	}
+	if (!thread && !(thread = thread_new(stack_sz))) {
+		return 0;
+	}
+	stack = thread->stack;
+	stack_cap = thread->stack_cap;
+	memset(thread, 0, sizeof(pthread_internal_t));
+	thread->stack = stack;
+	thread->stack_cap = stack_cap;
+	lle_init(&thread->ll);
+	return thread;
+}
+
+/**
+ * @brief Take a thread off the live list, if it is still on it.
+ */
+static void live_del_locked(pthread_internal_t * thread)
+{
+	if (lle_linked(&thread->ll)) {
+		lle_del(&thread->ll);
+		cache.nlive--;
+	}
+}
+
+/**
+ * @brief Take a finished thread off the live list, then put it in the
+ * cache, or free it if its class is full.
+ */
+static void thread_free(pthread_internal_t * thread)
+{
+	int c = stack_class(thread->stack_cap);
+
+	mut_lock(&cache.mux, WAIT);
+	live_del_locked(thread);
+	if ((c >= 0) && (cache.n[c] < POSIX_THREAD_CACHE_MAX)) {
+		ll_addt(&cache.idle[c], &thread->ll);
+		cache.n[c]++;
+		thread = 0;
+	}
+	mut_unlock(&cache.mux);
+	if (thread) {
+		hcos_posix_free(POSIX_STACK, thread->stack);
+		hcos_posix_free(POSIX_THREAD, thread);
+	}
+}
+
+#if POSIX_STACK_PAINT
+/**
+ * @brief Fill the whole stack with POSIX_STACK_PAINT_WORD.
+ */
+static void stack_paint(pthread_internal_t * thread)
+{
+	unsigned i, n = thread->stack_cap / sizeof(unsigned);
+
+	for (i = 0; i < n; i++) {
+		thread->stack[i] = POSIX_STACK_PAINT_WORD;
+	}
+}
+
+/**
+ * @brief Bytes of the stack written since it was painted.
+ *
+ * Stacks grow down, so the scan runs from the low end up to the first word
+ * that lost the pattern.
+ */
+static size_t stack_peak(pthread_internal_t * thread)
+{
+	unsigned i, n = thread->stack_cap / sizeof(unsigned);
+
+	for (i = 0; i < n; i++) {
+		if (thread->stack[i] != POSIX_STACK_PAINT_WORD) {
+			break;
+		}
+	}
+	return (size_t)(n - i) * sizeof(unsigned);
+}
+#endif
+
+/**
+ * @brief Reclaim the ended threads whose tasks the kernel reports dead.
+ *
+ * Only then are the task_t and the stack no longer in use, so the object
+ * and stack can go back to the cache. The others stay for a later call.
+ */
+static void thread_reap(void)
+{
+	pthread_internal_t *thread;
+	lle_t *p, *t;
+	ll_t dead;
+
+	ll_init(&dead);
+	mut_lock(&cache.mux, WAIT);
+	ll_for_each_mod(&cache.zombie, p, t) {
+		thread = lle_get(p, pthread_internal_t, ll);
+		if (task_dead(&thread->task)) {
+			lle_del(p);
+			ll_addt(&dead, p);
+		}
+	}
+	mut_unlock(&cache.mux);
+	while ((p = ll_head(&dead)) != 0) {
+		lle_del(p);
+		thread_free(lle_get(p, pthread_internal_t, ll));
+	}
+}
+
+/**
+ * @brief Run the destructors of the calling thread's key values.
+ *
+ * A destructor may set values again, so the keys are walked up to
+ * POSIX_THREAD_DESTRUCTOR_ITERATIONS times.
+ */
+static void keys_destroy(pthread_internal_t * thread)
+{
+	void (*destructor) (void *);
+	int i, k, again = 1;
+	void *value;
+
+	for (i = 0; again && (i < POSIX_THREAD_DESTRUCTOR_ITERATIONS); i++) {
+		again = 0;
+		for (k = 0; k < POSIX_THREAD_KEYS_MAX; k++) {
+			if (!(value = thread->specific[k])) {
+				continue;
+			}
+			thread->specific[k] = 0;
+			destructor = keys[k].destructor;
+			if (keys[k].used && destructor) {
+				destructor(value);
+				again = 1;
+			}
+		}
+	}
+}
+
 /**
  * @brief Terminates the calling thread.
  *
- * For joinable threads, this function waits for pthread_join. Otherwise,
- * it deletes the thread and frees up resources used by the thread.
+ * Runs the key destructors. For joinable threads, this function then waits
+ * for pthread_join. Either way the thread moves from the live list to the
+ * zombie list, as its task still runs on the stack until it ends.
  *
- * @return This function does not return.
+ * @note This function returns; the caller must then end the task, by
+ * returning from the task function or with task_exit.
  */
 static void exit_thread(void)
 {
 	pthread_internal_t *thread = (pthread_internal_t *) pthread_self();
 
+	keys_destroy(thread);
+
 	// If this thread is joinable, wait for a call to pthread_join
 	if (STATUS_JOINABLE(thread->attr.status)) {
 		sem_post(&thread->barrier);
 		sem_get(&thread->joined, WAIT);
-	} else {
-		hcos_posix_free(POSIX_STACK, thread->stack);
-		hcos_posix_free(POSIX_THREAD, thread);
 	}
+	thread_reap();
+	mut_lock(&cache.mux, WAIT);
+	live_del_locked(thread);
+	ll_addt(&cache.zombie, &thread->ll);
+	mut_unlock(&cache.mux);
 }
 
 /**
@@ -104,7 +354,7 @@ static void run_thread(void *pxArg)
 	// Run the thread routine.
 	thread->ret = thread->fun((void *)thread->fun_arg);
 
-	// Exit once finished. This function does not return.
+	// Exit once finished; returning ends the task.
 	exit_thread();
 }
 
@@ -215,12 +465,11 @@ int pthread_create(pthread_t * _thread,
 		errno = EAGAIN;
 		ret = -1;
 	} else {
-		// Allocate memory for new thread object.
-		thread =
-		    (pthread_internal_t *) hcos_posix_alloc(POSIX_THREAD,
-							    sizeof
-							    (pthread_internal_t));
-		memset(thread, 0, sizeof(pthread_internal_t));
+		// Take an idle thread object and stack, or allocate new ones.
+		cache_check_init();
+		thread_reap();
+		thread = thread_alloc(attr ? attr->stack_sz :
+				      PTHTREAD_ATTR_DEFAULT.stack_sz);
 	}
 	if (!thread) {
 		// No memory.
@@ -249,29 +498,29 @@ int pthread_create(pthread_t * _thread,
 		// pthread_join.
 		if (STATUS_JOINABLE(thread->attr.status)) {
 			mut_init(&thread->mux);
-			sem_init(&thread->barrier, 1);
-			sem_init(&thread->joined, 1);
+			sem_init(&thread->barrier, 0);
+			sem_init(&thread->joined, 0);
 		}
+#if POSIX_STACK_PAINT
+		stack_paint(thread);
+#endif
+		// Go on the live list before the task can run, and end, on
+		// its own.
+		mut_lock(&cache.mux, WAIT);
+		ll_addt(&cache.live, &thread->ll);
+		cache.nlive++;
+		mut_unlock(&cache.mux);
 	}
 
-	if (ret == 0) {
-		thread->stack =
-		    hcos_posix_alloc(POSIX_STACK, thread->attr.stack_sz);
-		if (thread->stack == 0) {
-			hcos_posix_free(POSIX_THREAD, thread);
-			ret = EAGAIN;
-		}
-	}
 	if (ret == 0) {
 		if (task_init(&thread->task,
 			      "pthread",
 			      run_thread,
 			      param.sched_priority,
 			      thread->stack,
-			      thread->attr.stack_sz, 10, (void *)thread)) {
+			      thread->stack_cap, 10, (void *)thread)) {
 			// Task creation failed, no memory.
-			hcos_posix_free(POSIX_STACK, thread->stack);
-			hcos_posix_free(POSIX_THREAD, thread);
+			thread_free(thread);
 			ret = EAGAIN;
 		} else {
 			*_thread = (pthread_t) thread;
@@ -281,6 +530,141 @@ int pthread_create(pthread_t * _thread,
 	return ret;
 }
 
+int pthread_cache_prewarm(size_t stacksize, unsigned count)
+{
+	pthread_internal_t *thread;
+	int c = stack_class(stacksize);
+	int full;
+
+	if ((c < 0) || (hcos_posix_alloc == 0)) {
+		return EINVAL;
+	}
+	cache_check_init();
+	thread_reap();
+	for (;;) {
+		mut_lock(&cache.mux, WAIT);
+		full = (cache.n[c] >= count) ||
+		    (cache.n[c] >= POSIX_THREAD_CACHE_MAX);
+		mut_unlock(&cache.mux);
+		if (full) {
+			return 0;
+		}
+		if (!(thread = thread_new(stacksize))) {
+			return EAGAIN;
+		}
+		thread_free(thread);
+	}
+}
+
+int pthread_getstackusage_np(pthread_t _thread, size_t * size, size_t * peak)
+{
+	pthread_internal_t *thread = (pthread_internal_t *) _thread;
+
+	if (!thread || !size || !peak) {
+		return EINVAL;
+	}
+#if POSIX_STACK_PAINT
+	*size = thread->stack_cap;
+	*peak = stack_peak(thread);
+	return 0;
+#else
+	return ENOTSUP;
+#endif
+}
+
+int pthread_liststacks_np(pthread_stackinfo_np_t * info, unsigned max)
+{
+	pthread_internal_t *thread;
+	unsigned i = 0;
+	int n;
+	lle_t *p;
+
+	cache_check_init();
+	mut_lock(&cache.mux, WAIT);
+	ll_for_each(&cache.live, p) {
+		if (i >= max) {
+			break;
+		}
+		thread = lle_get(p, pthread_internal_t, ll);
+		info[i].thread = (pthread_t) thread;
+		info[i].size = thread->stack_cap;
+#if POSIX_STACK_PAINT
+		info[i].peak = stack_peak(thread);
+#else
+		info[i].peak = 0;
+#endif
+		i++;
+	}
+	n = (int)cache.nlive;
+	mut_unlock(&cache.mux);
+	return n;
+}
+
+int pthread_key_create(pthread_key_t * key, void (*destructor) (void *))
+{
+	pthread_internal_t *thread;
+	int ret = EAGAIN;
+	pthread_key_t k;
+	lle_t *p;
+
+	cache_check_init();
+	mut_lock(&cache.mux, WAIT);
+	for (k = 0; k < POSIX_THREAD_KEYS_MAX; k++) {
+		if (!keys[k].used) {
+			break;
+		}
+	}
+	if (k < POSIX_THREAD_KEYS_MAX) {
+		// A deleted key may have left values behind.
+		ll_for_each(&cache.live, p) {
+			thread = lle_get(p, pthread_internal_t, ll);
+			thread->specific[k] = 0;
+		}
+		keys[k].destructor = destructor;
+		keys[k].used = 1;
+		*key = k;
+		ret = 0;
+	}
+	mut_unlock(&cache.mux);
+	return ret;
+}
+
+int pthread_key_delete(pthread_key_t key)
+{
+	int ret = EINVAL;
+
+	cache_check_init();
+	mut_lock(&cache.mux, WAIT);
+	if ((key < POSIX_THREAD_KEYS_MAX) && keys[key].used) {
+		keys[key].used = 0;
+		keys[key].destructor = 0;
+		ret = 0;
+	}
+	mut_unlock(&cache.mux);
+	return ret;
+}
+
+void *pthread_getspecific(pthread_key_t key)
+{
+	pthread_internal_t *thread = (pthread_internal_t *) pthread_self();
+
+	if (!thread || (key >= POSIX_THREAD_KEYS_MAX)) {
+		return 0;
+	}
+	return thread->specific[key];
+}
+
+int pthread_setspecific(pthread_key_t key, const void *value)
+{
+	pthread_internal_t *thread = (pthread_internal_t *) pthread_self();
+
+	if (!thread || (key >= POSIX_THREAD_KEYS_MAX) || !keys[key].used) {
+		return EINVAL;
+	}
+	thread->specific[key] = (void *)value;
+	return 0;
+}
+
 int pthread_getschedparam(pthread_t _thread,
 			  int *policy, struct sched_param *param)
 {
@@ -309,6 +693,7 @@ void pthread_exit(void *value_ptr)
 	// Set the return value
 	thread->ret = value_ptr;
 	exit_thread();
+	task_exit();
 }
 
 int pthread_join(pthread_t pthread, void **retval)
@@ -341,13 +726,15 @@ int pthread_join(pthread_t pthread, void **retval)
 		// Wait for the joining thread to finish. Because this call waits forever,
 		// it should never fail.
 		sem_get(&thread->barrier, WAIT);
-		sem_post(&thread->joined);
-		mut_unlock(&thread->mux);
 		if (retval) {
 			*retval = thread->ret;
 		}
-		hcos_posix_free(POSIX_STACK, thread->stack);
-		hcos_posix_free(POSIX_THREAD, thread);
+		mut_unlock(&thread->mux);
+		mut_lock(&cache.mux, WAIT);
+		live_del_locked(thread);
+		mut_unlock(&cache.mux);
+		// The thread retires itself once woken, so this is the last access.
+		sem_post(&thread->joined);
 	}
 
 	return ret;
@@ -355,7 +742,14 @@ int pthread_join(pthread_t pthread, void **retval)
 
 pthread_t pthread_self(void)
 {
-	return (pthread_t) _task_cur->priv;
+	pthread_internal_t *thread = (pthread_internal_t *) _task_cur->priv;
+
+	// Other tasks may keep anything in priv; only a pthread's task sits
+	// inside the object it points to.
+	if (!thread || (&thread->task != _task_cur)) {
+		return 0;
+	}
+	return (pthread_t) thread;
 }
 
 int pthread_setschedparam(pthread_t _thread,
@@ -85,7 +85,7 @@ int pthread_mutex_lock(pthread_mutex_t * mux)
 int pthread_mutex_timedlock(pthread_mutex_t * mux,
 			    const struct timespec *abstime)
 {
-	unsigned sleep_ticks;
+	unsigned sleep_ticks = WAIT;
 	int ret = 0;
 	if (mux->inited == 0)
 		return EINVAL;
@@ -112,7 +112,9 @@ int pthread_mutex_timedlock(pthread_mutex_t * mux,
 	}
 
 	if (ret == 0) {
-		mut_lock(&mux->mux, sleep_ticks);
+		if (mut_lock(&mux->mux, sleep_ticks) != 0) {
+			ret = ETIMEDOUT;
+		}
 	}
 
 	return ret;
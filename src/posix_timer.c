@@ -47,6 +47,7 @@
  */
 
 #include <stddef.h>
+#include <string.h>
 #include <errno.h>
 #include <pthread.h>
 #include <signal.h>
@@ -83,23 +84,7 @@ static int timer_do(void *p)
 		tmr_on(&timer->ost, timer->period);
 	}
 	// Create the timer notification thread if requested.
-	if (timer->event.sigev_notify == SIGEV_THREAD) {
-		// if the user has provided thread attributes, create a thread
-		// with the provided attributes. Otherwise dispatch callback directly
-		if (timer->event.sigev_notify_attributes == 0) {
-			timer->event.sigev_notify_function(timer->
-							   event.sigev_value);
-		} else {
-			pthread_t thread;
-			(void)pthread_create(&thread,
-					     timer->
-					     event.sigev_notify_attributes,
-					     (void *(*)(void *))
-					     timer->event.sigev_notify_function,
-					     timer->event.
-					     sigev_value.sival_ptr);
-		}
-	}
+	sigevent_dispatch(&timer->event);
 	return 0;
 }
 
@@ -0,0 +1,229 @@
+/**
+ * Copyright (C) 2018 socware.net.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://socware.net
+ */
+#include <string.h>
+
+#include <errno.h>
+#include <hcos_topic.h>
+#include "utils.h"
+
+#define TOPIC_DATA(_b)  ((void *)((_b) + 1))
+#define TOPIC_AT(_t, _i) \
+	((topic_buf_t *)((char *)(_t)->buf + (_i) * (_t)->slot_sz))
+
+/// mq_t items are words, a reference takes this many.
+#define TOPIC_REF_WORDS (sizeof(topic_buf_t *) / sizeof(unsigned))
+
+/**
+ * @brief Drop a reference, returning the buffer to the topic with the last.
+ */
+static void topic_buf_put(topic_t * topic, topic_buf_t * b)
+{
+	if (__atomic_sub_fetch(&b->ref, 1, __ATOMIC_ACQ_REL) != 0) {
+		return;
+	}
+	mut_lock(&topic->mux, WAIT);
+	b->next = topic->free;
+	topic->free = b;
+	topic->nfree++;
+	mut_unlock(&topic->mux);
+	sem_post(&topic->avail);
+}
+
+/**
+ * @brief Map a payload pointer back to its buffer.
+ *
+ * @return The buffer, or 0 if msg is not a payload of topic.
+ */
+static topic_buf_t *topic_buf_get(topic_t * topic, const void *msg)
+{
+	topic_buf_t *b = (topic_buf_t *) msg - 1;
+	uintptr_t off = (uintptr_t) b - (uintptr_t) topic->buf;
+
+	if (((char *)b < (char *)topic->buf) ||
+	    (off >= (uintptr_t) topic->nbufs * topic->slot_sz) ||
+	    (off % topic->slot_sz)) {
+		return 0;
+	}
+	return b;
+}
+
+int topic_init(topic_t * topic, unsigned nbufs, size_t bufsize)
+{
+	unsigned slot_sz = (sizeof(topic_buf_t) + bufsize + sizeof(void *) - 1)
+	    & ~(sizeof(void *) - 1);
+	topic_buf_t *b;
+	unsigned i;
+
+	if ((nbufs == 0) || (nbufs > 0xffff) || (bufsize > 0xffff)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (!(topic->buf = hcos_posix_alloc(POSIX_TOPIC, nbufs * slot_sz))) {
+		errno = ENOMEM;
+		return -1;
+	}
+	mut_init(&topic->mux);
+	sem_init(&topic->avail, nbufs);
+	ll_init(&topic->subs);
+	topic->nbufs = topic->nfree = nbufs;
+	topic->bufsize = bufsize;
+	topic->slot_sz = slot_sz;
+	topic->free = 0;
+	for (i = nbufs; i-- > 0;) {
+		b = TOPIC_AT(topic, i);
+		b->topic = topic;
+		b->next = topic->free;
+		topic->free = b;
+	}
+	return 0;
+}
+
+int topic_destroy(topic_t * topic)
+{
+	int ret = 0;
+
+	mut_lock(&topic->mux, WAIT);
+	if (!ll_empty(&topic->subs) || (topic->nfree != topic->nbufs)) {
+		errno = EBUSY;
+		ret = -1;
+	}
+	mut_unlock(&topic->mux);
+	if (ret == 0) {
+		hcos_posix_free(POSIX_TOPIC, topic->buf);
+		topic->buf = 0;
+	}
+	return ret;
+}
+
+int topic_subscribe(topic_t * topic, topic_sub_t * sub, unsigned depth)
+{
+	unsigned qsz = depth * sizeof(topic_buf_t *);
+
+	if (depth == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (!(sub->qbuf = hcos_posix_alloc(POSIX_TOPIC, qsz))) {
+		errno = ENOMEM;
+		return -1;
+	}
+	mq_init(&sub->q, TOPIC_REF_WORDS, sub->qbuf, qsz);
+	sub->topic = topic;
+	sub->dropped = 0;
+	lle_init(&sub->ll);
+	mut_lock(&topic->mux, WAIT);
+	ll_addt(&topic->subs, &sub->ll);
+	mut_unlock(&topic->mux);
+	return 0;
+}
+
+int topic_unsubscribe(topic_sub_t * sub)
+{
+	topic_t *topic = sub->topic;
+	topic_buf_t *b;
+
+	mut_lock(&topic->mux, WAIT);
+	lle_del(&sub->ll);
+	mut_unlock(&topic->mux);
+	// Nothing is queued any more, give back what is left.
+	while (mq_get(&sub->q, (unsigned *)&b, WAIT_NO) == 0) {
+		topic_buf_put(topic, b);
+	}
+	hcos_posix_free(POSIX_TOPIC, sub->qbuf);
+	return 0;
+}
+
+int topic_publish(topic_t * topic, const void *msg, size_t len,
+		  const struct timespec *abstime)
+{
+	topic_buf_t *b = 0;
+	unsigned timeout = 0;
+	int ret = 0;
+	lle_t *p;
+
+	if (len > topic->bufsize) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+	if (abstime2ticks(abstime, &timeout) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (sem_get(&topic->avail, timeout) != 0) {
+		errno = ETIMEDOUT;
+		return -1;
+	}
+	// The copy is made under the lock too, one lock round per message.
+	mut_lock(&topic->mux, WAIT);
+	b = topic->free;
+	topic->free = b->next;
+	topic->nfree--;
+	memcpy(TOPIC_DATA(b), msg, len);
+	b->len = len;
+	// Hold a reference while fanning out, so early releases by fast
+	// subscribers cannot free the buffer under us.
+	b->ref = 1;
+	ll_for_each(&topic->subs, p) {
+		topic_sub_t *sub = lle_get(p, topic_sub_t, ll);
+		__atomic_add_fetch(&b->ref, 1, __ATOMIC_RELAXED);
+		if (mq_put(&sub->q, (unsigned *)&b, WAIT_NO) != 0) {
+			__atomic_sub_fetch(&b->ref, 1, __ATOMIC_RELAXED);
+			sub->dropped++;
+		} else {
+			ret++;
+		}
+	}
+	mut_unlock(&topic->mux);
+	topic_buf_put(topic, b);
+	return ret;
+}
+
+const void *topic_receive(topic_sub_t * sub, size_t * len,
+			  const struct timespec *abstime)
+{
+	topic_buf_t *b = 0;
+	unsigned timeout = 0;
+
+	if (abstime2ticks(abstime, &timeout) != 0) {
+		errno = EINVAL;
+		return 0;
+	}
+	if (mq_get(&sub->q, (unsigned *)&b, timeout) != 0) {
+		errno = ETIMEDOUT;
+		return 0;
+	}
+	*len = b->len;
+	return TOPIC_DATA(b);
+}
+
+int topic_release(topic_sub_t * sub, const void *msg)
+{
+	topic_buf_t *b = topic_buf_get(sub->topic, msg);
+
+	if (!b) {
+		errno = EINVAL;
+		return -1;
+	}
+	topic_buf_put(sub->topic, b);
+	return 0;
+}
@@ -48,6 +48,9 @@
 #include <limits.h>
 
 #include <errno.h>
+#include <hcos/tmr.h>
+#include <pthread.h>
+#include <signal.h>
 #include <utils.h>
 
 static int timespec_sub(const struct timespec *const x,
@@ -231,3 +234,92 @@ int validate_timespec(const struct timespec *const time_spec)
 
 	return ret;
 }
+
+int abstime2ticks(const struct timespec *abstime, unsigned *ticks)
+{
+	struct timespec cur = { 0 };
+	int ret = 0;
+
+	*ticks = WAIT;
+	if (abstime != NULL) {
+		if ((validate_timespec(abstime) == false) ||
+		    (clock_gettime(CLOCK_REALTIME, &cur) != 0)) {
+			ret = EINVAL;
+		} else if (abs_timespec2ticks(abstime, &cur, ticks) != 0) {
+			// Already expired, only try once.
+			*ticks = 0;
+		}
+	}
+	return ret;
+}
+
+/**
+ * @brief Word used by mem_copy, allowed to alias the byte buffers.
+ */
+typedef unsigned long __attribute__ ((__may_alias__)) mem_word_t;
+
+#define MEM_WORD_SZ sizeof(mem_word_t)
+
+void mem_copy(void *dst, const void *src, size_t len)
+{
+	unsigned char *d = (unsigned char *)dst;
+	const unsigned char *s = (const unsigned char *)src;
+	mem_word_t *dw;
+	const mem_word_t *sw;
+	mem_word_t w0, w1, w2, w3;
+
+	// Short copies are not worth the alignment work.
+	if (len >= 2 * MEM_WORD_SZ) {
+		for (; (uintptr_t) d & (MEM_WORD_SZ - 1); len--) {
+			*d++ = *s++;
+		}
+		dw = (mem_word_t *) d;
+		if (!((uintptr_t) s & (MEM_WORD_SZ - 1))) {
+			sw = (const mem_word_t *)s;
+			for (; len >= 4 * MEM_WORD_SZ; len -= 4 * MEM_WORD_SZ) {
+				w0 = sw[0];
+				w1 = sw[1];
+				w2 = sw[2];
+				w3 = sw[3];
+				dw[0] = w0;
+				dw[1] = w1;
+				dw[2] = w2;
+				dw[3] = w3;
+				sw += 4;
+				dw += 4;
+			}
+			for (; len >= MEM_WORD_SZ; len -= MEM_WORD_SZ) {
+				*dw++ = *sw++;
+			}
+			s = (const unsigned char *)sw;
+		} else {
+			for (; len >= MEM_WORD_SZ; len -= MEM_WORD_SZ) {
+				__builtin_memcpy(&w0, s, MEM_WORD_SZ);
+				*dw++ = w0;
+				s += MEM_WORD_SZ;
+			}
+		}
+		d = (unsigned char *)dw;
+	}
+	while (len--) {
+		*d++ = *s++;
+	}
+}
+
+void sigevent_dispatch(const struct sigevent *ev)
+{
+	if (ev->sigev_notify == SIGEV_THREAD) {
+		// if the user has provided thread attributes, create a thread
+		// with the provided attributes. Otherwise dispatch callback directly
+		if (ev->sigev_notify_attributes == 0) {
+			ev->sigev_notify_function(ev->sigev_value);
+		} else {
+			pthread_t thread;
+			(void)pthread_create(&thread,
+					     ev->sigev_notify_attributes,
+					     (void *(*)(void *))
+					     ev->sigev_notify_function,
+					     ev->sigev_value.sival_ptr);
+		}
+	}
+}
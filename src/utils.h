@@ -55,6 +55,7 @@
 
 /* C standard library includes. */
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <time.h>
 
@@ -76,6 +77,17 @@ int abs_timespec2ticks(const struct timespec *const
 		       const struct timespec *const
 		       pxCurrentTime, unsigned *const pxResult);
 
+/**
+ * @brief Converts an optional absolute CLOCK_REALTIME timeout to ticks.
+ *
+ * @param[in] abstime The timeout, or NULL to wait forever.
+ * @param[out] ticks WAIT if abstime is NULL, 0 if it has passed, otherwise
+ * the ticks left until it.
+ *
+ * @return 0 on success. Otherwise, EINVAL if abstime is invalid.
+ */
+int abstime2ticks(const struct timespec *abstime, unsigned *ticks);
+
 /**
  * @brief Converts a struct timespec to FreeRTOS ticks.
  *
@@ -109,4 +121,29 @@ void nano2timespec(int64_t llSource, struct timespec *const pxDestination);
 */
 int validate_timespec(const struct timespec *const pxTimespec);
 
+/**
+ * @brief Copy len bytes between buffers of any alignment.
+ *
+ * Bytes are copied up to a word boundary of dst, then four words at a
+ * time and the remaining words one at a time, then the tail bytes. Words
+ * are loaded directly when src ends up aligned as well, otherwise through
+ * unaligned loads, which the compiler splits on cores without them.
+ *
+ * @param[out] dst Destination, must not overlap src.
+ * @param[in] src Source.
+ * @param[in] len Bytes to copy.
+ */
+void mem_copy(void *dst, const void *src, size_t len);
+
+/**
+ * @brief Deliver a SIGEV_THREAD notification.
+ *
+ * Without sigev_notify_attributes the function is called directly in the
+ * caller's context, otherwise it runs in a new thread created with them.
+ * Other notification types deliver nothing.
+ *
+ * @param[in] ev The event to deliver.
+ */
+void sigevent_dispatch(const struct sigevent *ev);
+
 #endif /* ifndef _HCOS_POSIX_UTILS_ */